@@ -17,16 +17,26 @@
 #include <ArduinoJson.h>
 #include <ESPFS.h>
 #include <EventSocket.h>
+#include <functional>
+#include <vector>
 
 #define MAX_ESP_ANALYTICS_SIZE 1024
 #define EVENT_ANALYTICS "analytics"
 #define ANALYTICS_INTERVAL 2000
 
+typedef std::function<void(JsonObject &root)> AnalyticsSource;
+
 class AnalyticsService
 {
 public:
     AnalyticsService(EventSocket *socket) : _socket(socket){};
 
+    // Adds application fields to the payload, register before begin()
+    void addSource(AnalyticsSource source)
+    {
+        _sources.push_back(source);
+    };
+
     void begin()
     {
         _socket->registerEvent(EVENT_ANALYTICS);
@@ -44,6 +54,7 @@ public:
 
 protected:
     EventSocket *_socket;
+    std::vector<AnalyticsSource> _sources;
 
     static void _loopImpl(void *_this) { static_cast<AnalyticsService *>(_this)->_loop(); }
     void _loop()
@@ -62,6 +73,10 @@ protected:
             doc["core_temp"] = temperatureRead();
 
             JsonObject jsonObject = doc.as<JsonObject>();
+            for (AnalyticsSource &source : _sources)
+            {
+                source(jsonObject);
+            }
             _socket->emitEvent(EVENT_ANALYTICS, jsonObject);
 
             vTaskDelayUntil(&xLastWakeTime, ANALYTICS_INTERVAL / portTICK_PERIOD_MS);
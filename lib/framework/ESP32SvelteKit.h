@@ -151,6 +151,13 @@ public:
         return &_featureService;
     }
 
+#if FT_ENABLED(FT_ANALYTICS)
+    AnalyticsService *getAnalyticsService()
+    {
+        return &_analyticsService;
+    }
+#endif
+
     void factoryReset()
     {
         _factoryResetService.factoryReset();
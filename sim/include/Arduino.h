@@ -0,0 +1,156 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Host stand-in for the parts of the Arduino core and FreeRTOS the portable
+// sources use, for the native test and simulator builds. Time is simulated :
+// millis() and micros() only move with advanceMicros(). Tasks and queues are
+// never created, callers fall back to their synchronous paths.
+
+#include <math.h>
+#include <cmath>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+
+using std::abs;
+using std::isinf;
+using std::isnan;
+using std::max;
+using std::min;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PI 3.1415926535897932384626433832795
+#define HALF_PI 1.5707963267948966192313216916398
+#define TWO_PI 6.283185307179586476925286766559
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+#define radians(deg) ((deg)*DEG_TO_RAD)
+#define degrees(rad) ((rad)*RAD_TO_DEG)
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+#define sq(x) ((x)*(x))
+
+#define OUTPUT 0x03
+#define INPUT 0x01
+#define HIGH 0x1
+#define LOW 0x0
+#define BIN 2
+#define DEC 10
+
+static const uint8_t TX = 43;
+static const uint8_t RX = 44;
+static const uint8_t SDA = 8;
+static const uint8_t SCL = 9;
+
+inline uint64_t &simulatedMicros() {
+    static uint64_t elapsed = 0;
+    return elapsed;
+}
+inline void advanceMicros(uint64_t dt) {simulatedMicros() += dt;}
+inline unsigned long micros() {return (unsigned long)simulatedMicros();}
+inline unsigned long millis() {return (unsigned long)(simulatedMicros() / 1000);}
+inline void delay(uint32_t ms) {advanceMicros(uint64_t(ms) * 1000);}
+inline void delayMicroseconds(uint32_t us) {advanceMicros(us);}
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) {return LOW;}
+
+class String : public std::string
+{
+public:
+    String() {}
+    String(const char *s) : std::string(s) {}
+    String(const std::string &s) : std::string(s) {}
+    String(int value) : std::string(std::to_string(value)) {}
+    String(unsigned int value) : std::string(std::to_string(value)) {}
+    String(long value) : std::string(std::to_string(value)) {}
+    String(unsigned long value) : std::string(std::to_string(value)) {}
+    String(float value) : std::string(std::to_string(value)) {}
+    String(double value) : std::string(std::to_string(value)) {}
+};
+
+#define SERIAL_8N1 0x800001c
+
+enum hardwareSerialError_t {
+    UART_NO_ERROR,
+    UART_BREAK_ERROR,
+    UART_BUFFER_FULL_ERROR,
+    UART_FIFO_OVF_ERROR,
+    UART_FRAME_ERROR,
+    UART_PARITY_ERROR
+};
+
+// Console output is dropped, the tests and the simulator report on stdout.
+// Nothing is ever received.
+class HardwareSerial
+{
+public:
+    void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1) {}
+    size_t setRxBufferSize(size_t size) {return size;}
+    void onReceive(std::function<void(void)> function) {}
+    void onReceiveError(std::function<void(hardwareSerialError_t)> function) {}
+    int available() {return 0;}
+    int read() {return -1;}
+    template<typename... Args>
+    void printf(const char *format, Args... args) {}
+    template<typename T>
+    void print(T value, int base = DEC) {}
+    template<typename T>
+    void println(T value, int base = DEC) {}
+    void println() {}
+};
+inline HardwareSerial &nativeSerial() {
+    static HardwareSerial serial;
+    return serial;
+}
+#define Serial nativeSerial()
+inline HardwareSerial &nativeSerial1() {
+    static HardwareSerial serial;
+    return serial;
+}
+#define Serial1 nativeSerial1()
+
+#define ESP_LOGE(tag, format, ...) do {} while (0)
+#define ESP_LOGW(tag, format, ...) do {} while (0)
+#define ESP_LOGI(tag, format, ...) do {} while (0)
+#define ESP_LOGD(tag, format, ...) do {} while (0)
+#define ESP_LOGV(tag, format, ...) do {} while (0)
+
+// FreeRTOS
+typedef void *TaskHandle_t;
+typedef void *QueueHandle_t;
+typedef std::mutex *SemaphoreHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xFFFFFFFF
+#define configMAX_PRIORITIES 25
+#define tskIDLE_PRIORITY 0
+#define tskNO_AFFINITY 0x7FFFFFFF
+#define CONFIG_ARDUINO_RUNNING_CORE 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+inline BaseType_t xTaskCreatePinnedToCore(void (*)(void *), const char *, uint32_t, void *, UBaseType_t, TaskHandle_t *, BaseType_t) {return pdFAIL;}
+inline BaseType_t xTaskCreate(void (*)(void *), const char *, uint32_t, void *, UBaseType_t, TaskHandle_t *) {return pdFAIL;}
+inline TickType_t xTaskGetTickCount() {return millis();}
+inline void vTaskDelay(TickType_t ticks) {delay(ticks);}
+inline void vTaskDelayUntil(TickType_t *previous, TickType_t ticks) {*previous += ticks;}
+inline SemaphoreHandle_t xSemaphoreCreateMutex() {return new std::mutex();}
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t) {mutex->lock(); return pdTRUE;}
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex) {mutex->unlock(); return pdTRUE;}
+inline QueueHandle_t xQueueCreate(UBaseType_t, UBaseType_t) {return nullptr;}
+inline BaseType_t xQueueSend(QueueHandle_t, const void *, TickType_t) {return pdFAIL;}
+inline BaseType_t xQueueReceive(QueueHandle_t, void *, TickType_t) {return pdFAIL;}
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef NATIVE_FAST_ACCEL_STEPPER_H
+#define NATIVE_FAST_ACCEL_STEPPER_H
+
+#include <Arduino.h>
+
+// Host stand-in for FastAccelStepper. Steps are generated in simulated time
+// with trapezoidal ramps, the state is brought up to micros() on every call.
+// The linear acceleration (jerk) phase is not modelled.
+class FastAccelStepper
+{
+public:
+    void setDirectionPin(uint8_t pin) {}
+    int8_t setSpeedInHz(uint32_t speed) {return setSpeedInMilliHz(speed * 1000);}
+    int8_t setSpeedInMilliHz(uint32_t speed) {
+        update();
+        maxSpeed = speed * 0.001;
+        return 0;
+    }
+    int8_t setAcceleration(int32_t value) {
+        update();
+        acceleration = value;
+        return 0;
+    }
+    void setLinearAcceleration(uint32_t steps) {}
+    uint32_t getSpeedInMilliHz() {return uint32_t(maxSpeed * 1000.);}
+    int32_t getAcceleration() {return int32_t(acceleration);}
+    int32_t getCurrentSpeedInMilliHz() {
+        update();
+        return int32_t(speed * 1000.);
+    }
+    int32_t getCurrentPosition() {
+        update();
+        return int32_t(lround(position));
+    }
+    // The target moves along, as on the device
+    void setCurrentPosition(int32_t value) {
+        update();
+        int32_t shift = value - int32_t(lround(position));
+        position += shift;
+        target += shift;
+    }
+    int32_t targetPos() {return target;}
+    int8_t moveTo(int32_t value, bool blocking = false) {
+        update();
+        target = value;
+        mode = MOVE;
+        return 0;
+    }
+    int8_t move(int32_t steps, bool blocking = false) {
+        return moveTo(target + steps);
+    }
+    int8_t runForward() {
+        update();
+        mode = RUN_FORWARD;
+        return 0;
+    }
+    int8_t runBackward() {
+        update();
+        mode = RUN_BACKWARD;
+        return 0;
+    }
+    void stopMove() {
+        update();
+        if (mode != IDLE) mode = STOP;
+    }
+    void forceStop() {
+        update();
+        mode = IDLE;
+        speed = 0.;
+        target = int32_t(lround(position));
+    }
+    bool isRunning() {
+        update();
+        return mode != IDLE;
+    }
+    // steps taken since the start, for the plant models
+    double getExactPosition() {
+        update();
+        return position;
+    }
+
+private:
+    enum Mode {IDLE, MOVE, RUN_FORWARD, RUN_BACKWARD, STOP};
+    Mode mode = IDLE;
+    double position = 0.;
+    double speed = 0.;
+    double maxSpeed = 1.;
+    double acceleration = 1.;
+    int32_t target = 0;
+    uint64_t lastUpdate = 0;
+
+    void update() {
+        uint64_t now = simulatedMicros();
+        if (mode == IDLE) lastUpdate = now;
+        while (lastUpdate < now) {
+            uint64_t step = min(now - lastUpdate, uint64_t(250));
+            advance(step * 1e-6);
+            lastUpdate += step;
+        }
+    }
+    // Speed towards a set point at the acceleration limit
+    void accelerate(double setPoint, double dt) {
+        double dv = acceleration * dt;
+        if (speed < setPoint) speed = min(setPoint, speed + dv);
+        else speed = max(setPoint, speed - dv);
+    }
+    void advance(double dt) {
+        switch (mode) {
+        case IDLE:
+            return;
+        case RUN_FORWARD:
+            accelerate(maxSpeed, dt);
+            break;
+        case RUN_BACKWARD:
+            accelerate(-maxSpeed, dt);
+            break;
+        case STOP:
+            accelerate(0., dt);
+            if (speed == 0.) mode = IDLE;
+            break;
+        case MOVE: {
+            double distance = target - position;
+            double braking = speed * speed / (2. * acceleration);
+            bool towards = speed * distance > 0.;
+            if (abs(distance) < 0.5 && abs(speed) <= acceleration * dt) {
+                position = target;
+                speed = 0.;
+                mode = IDLE;
+                return;
+            }
+            if (towards && abs(distance) <= braking) accelerate(0., dt);
+            else accelerate(distance > 0. ? maxSpeed : -maxSpeed, dt);
+            break;
+        }
+        }
+        position += speed * dt;
+    }
+};
+
+#define DRIVER_MCPWM_PCNT 0
+#define DRIVER_RMT 1
+#define DRIVER_DONT_CARE 2
+
+class FastAccelStepperEngine
+{
+public:
+    void init() {}
+    // Step generators left, as on the ESP32-S3
+    int mcpwmPcnt = 4;
+    int rmt = 4;
+    FastAccelStepper *stepperConnectToPin(uint8_t pin, uint8_t driver = DRIVER_DONT_CARE) {
+        int &available = driver == DRIVER_RMT || (driver == DRIVER_DONT_CARE && mcpwmPcnt == 0) ? rmt : mcpwmPcnt;
+        if (available == 0) return nullptr;
+        available--;
+        return new FastAccelStepper();
+    }
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef NATIVE_TMC_STEPPER_H
+#define NATIVE_TMC_STEPPER_H
+
+#include <Arduino.h>
+
+// Host stand-in for the TMC5160Stepper registers the firmware touches. The
+// registers only hold what was written, the ramp generator does not move.
+// IOIN reads as a connected v0x30 driver with SD_MODE high, hardware enabled.
+class TMC5160Stepper
+{
+public:
+    uint32_t ioin = 0x30000000 | 1u << 6;
+    uint32_t drvStatus = 0;
+
+    TMC5160Stepper(uint16_t pinCS, float RS, uint16_t pinMOSI, uint16_t pinMISO, uint16_t pinSCK, int8_t link = -1) {}
+    TMC5160Stepper(uint16_t pinCS, float RS = 0.075f, int8_t link = -1) {}
+
+    void begin() {}
+    void defaults() {}
+    uint32_t IOIN() {return ioin;}
+    uint32_t DRV_STATUS() {return drvStatus;}
+    void GSTAT(uint8_t value) {}
+    uint8_t GSTAT() {return 0;}
+    void en_pwm_mode(bool value) {}
+    void s2g_level(uint8_t value) {}
+    void s2vs_level(uint8_t value) {}
+    void bbmclks(uint8_t value) {}
+    void shaft(bool value) {shaftValue = value;}
+    bool shaft() {return shaftValue;}
+    void toff(uint8_t value) {toffValue = value;}
+    uint8_t toff() {return toffValue;}
+    void microsteps(uint16_t value) {microstepsValue = value;}
+    uint16_t microsteps() {return microstepsValue;}
+    void rms_current(uint16_t value) {rmsCurrent = value;}
+    uint16_t rms_current() {return rmsCurrent;}
+    uint8_t pwm_freq() {return 0;}
+    uint8_t freewheel() {return 0;}
+
+    void RAMPMODE(uint8_t value) {rampMode = value;}
+    uint8_t RAMPMODE() {return rampMode;}
+    void VSTART(uint32_t value) {}
+    void VSTOP(uint32_t value) {}
+    void VMAX(uint32_t value) {}
+    void v1(uint32_t value) {}
+    void AMAX(uint16_t value) {}
+    void a1(uint16_t value) {}
+    void DMAX(uint16_t value) {}
+    void d1(uint16_t value) {}
+    void XTARGET(int32_t value) {xtarget = value;}
+    int32_t XTARGET() {return xtarget;}
+    void XACTUAL(int32_t value) {xactual = value;}
+    int32_t XACTUAL() {return xactual;}
+    int32_t VACTUAL() {return 0;}
+
+private:
+    bool shaftValue = false;
+    uint8_t toffValue = 0;
+    uint16_t microstepsValue = 256;
+    uint16_t rmsCurrent = 0;
+    uint8_t rampMode = 0;
+    int32_t xtarget = 0;
+    int32_t xactual = 0;
+};
+
+#endif
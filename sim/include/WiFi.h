@@ -0,0 +1,9 @@
+#ifndef NATIVE_WIFI_H
+#define NATIVE_WIFI_H
+
+#include <Arduino.h>
+
+// Host stand-in, the portable sources include WiFi.h but have no network
+// code outside the firmware services
+
+#endif
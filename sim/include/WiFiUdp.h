@@ -0,0 +1,6 @@
+#ifndef NATIVE_WIFI_UDP_H
+#define NATIVE_WIFI_UDP_H
+
+#include <WiFi.h>
+
+#endif
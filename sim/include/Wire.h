@@ -0,0 +1,28 @@
+#ifndef NATIVE_WIRE_H
+#define NATIVE_WIRE_H
+
+#include <Arduino.h>
+
+// Host stand-in for the I2C bus, no device ever answers
+class TwoWire
+{
+public:
+    bool begin(int sda, int scl, uint32_t frequency = 0) {return true;}
+    void setClock(uint32_t frequency) {}
+    void beginTransmission(uint8_t address) {}
+    size_t write(uint8_t value) {return 1;}
+    uint8_t endTransmission(bool sendStop = true) {return 2;}
+    uint8_t requestFrom(uint8_t address, uint8_t size) {return 0;}
+    int available() {return 0;}
+    int read() {return -1;}
+    size_t readBytes(uint8_t *buffer, size_t size) {return 0;}
+};
+
+inline TwoWire &nativeWire(int bus) {
+    static TwoWire buses[2];
+    return buses[bus];
+}
+#define Wire nativeWire(0)
+#define Wire1 nativeWire(1)
+
+#endif
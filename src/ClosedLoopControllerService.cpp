@@ -42,7 +42,7 @@ void ClosedLoopControllerStateService::onConfigUpdated(const String &originId)
         for (int i = 0; i < _controllers.size(); i++) {
             auto controller = _controllers[i];
             auto state = _state.controllers[i];
-            controller->targetAngle = state.targetAngle;
+            controller->targetAngle = BinaryAngle::fromDegrees(state.targetAngle);
         }
     }
 }
@@ -99,15 +99,20 @@ void ClosedLoopControllerSettingsService::onConfigUpdated()
         controller->enabled = settings.enabled;
         controller->hasLimits = settings.hasLimits;
         controller->tolerance = settings.tolerance;
-        controller->limitA = settings.limitA;
-        controller->limitB = settings.limitB;
+        controller->limitA = BinaryAngle::fromDegrees(settings.limitA);
+        controller->limitB = BinaryAngle::fromDegrees(settings.limitB);
     }
 }
 
 JsonRouter<ClosedLoopController> ClosedLoopControllerJsonRouter::router = JsonRouter<ClosedLoopController>(
 {
     {"calibration", [](JsonVariant content, ClosedLoopController &controller) {
-        return calibrationRouter.parse(content, controller);
+        bool parsed = calibrationRouter.parse(content, controller);
+        // the format of the offsets comes with them, never from the values
+        if (content["offsets"].is<JsonArray>()) {
+            parsed = parseOffsets(content["offsets"], content["version"] | 1, controller) || parsed;
+        }
+        return parsed;
     }},
     {"offset", [](JsonVariant content, ClosedLoopController &controller) {
         if (content.is<double>()) {
@@ -122,6 +127,26 @@ JsonRouter<ClosedLoopController> ClosedLoopControllerJsonRouter::router = JsonRo
     {"invert", [](JsonVariant content, ClosedLoopController &controller) {
         if (content.is<bool>()) {
             controller.encoder.invert = content.as<bool>();
+            controller.estimator.reset();
+            return true;
+        }
+        else return false;
+    }},
+    {"slip", [](JsonVariant content, ClosedLoopController &controller) {
+        if (content.is<JsonObject>()) {
+            controller.estimator.slipThreshold = content["threshold"] | controller.estimator.slipThreshold;
+            controller.estimator.slipLag = content["lag"] | controller.estimator.slipLag;
+            if (content["resetStats"].is<JsonVariant>()) controller.resetSlipStats();
+            return true;
+        }
+        else return false;
+    }},
+    {"encoder", [](JsonVariant content, ClosedLoopController &controller) {
+        if (content.is<JsonObject>()) {
+            Encoder &encoder = controller.encoder;
+            encoder.filterSize = constrain(content["filterSize"] | encoder.filterSize, 1, Encoder::maxFilterSize);
+            encoder.maxRate = content["maxRate"] | encoder.maxRate;
+            if (content["resetStats"].is<JsonVariant>()) encoder.quality.reset();
             return true;
         }
         else return false;
@@ -147,22 +172,60 @@ JsonRouter<ClosedLoopController> ClosedLoopControllerJsonRouter::router = JsonRo
         }
         else return false;
     }},
+    {"mode", [](JsonVariant content, ClosedLoopController &controller) {
+        if (content.is<String>()) {
+            String mode = content.as<String>();
+            if (mode == "move") controller.setMode(ControlMode::MOVE);
+            else if (mode == "pid") controller.setMode(ControlMode::PID);
+            else return false;
+            return true;
+        }
+        else return false;
+    }},
+    {"pid", [](JsonVariant content, ClosedLoopController &controller) {
+        if (content.is<JsonObject>()) {
+            controller.kp = content["kp"] | controller.kp;
+            controller.ki = content["ki"] | controller.ki;
+            controller.kd = content["kd"] | controller.kd;
+            controller.resetPid();
+            return true;
+        }
+        else return false;
+    }},
     {"stepper", [](JsonVariant content, ClosedLoopController &controller) {
         return TMC5160ControllerJsonRouter::router.parse(content, controller.stepper);
     }},
 },
 {
     {"position", [](ClosedLoopController &controller, const JsonVariant target) {
-        target.set(controller.getAngle());
+        target.set(controller.cachedAngle);
+    }},
+    {"path", [](ClosedLoopController &controller, const JsonVariant target) {
+        AxisPath &path = controller.path;
+        target["start"] = path.getStart();
+        target["end"] = path.getEnd();
+        target["travel"] = path.getTravel();
+        target["span"] = path.getSpan();
+        target["clamped"] = path.clamped;
+        target["escaping"] = path.escaping;
+    }},
+    {"estimate", [](ClosedLoopController &controller, const JsonVariant target) {
+        AxisEstimator &estimator = controller.estimator;
+        target["valid"] = estimator.valid;
+        target["angle"] = controller.cachedAngle;
+        target["rate"] = controller.cachedRate;
+        target["slip"] = estimator.innovation;
+        target["slipping"] = estimator.slipping;
+        target["variance"] = estimator.variance;
     }},
     {"target", [](ClosedLoopController &controller, const JsonVariant target) {
-        target.set(controller.targetAngle);
+        target.set(controller.targetAngle.toDegrees());
     }},
     {"tolerance", [](ClosedLoopController &controller, const JsonVariant target) {
         target.set(controller.tolerance);
     }},
     {"offset", [](ClosedLoopController &controller, const JsonVariant target) {
-        target.set(controller.encoderOffset);
+        target.set(controller.encoderOffset.toDegrees());
     }},
     {"enabled", [](ClosedLoopController &controller, const JsonVariant target) {
         target.set(controller.enabled);
@@ -173,10 +236,30 @@ JsonRouter<ClosedLoopController> ClosedLoopControllerJsonRouter::router = JsonRo
     {"encoderError", [](ClosedLoopController &controller, const JsonVariant target) {
         target.set(controller.encoder.error);
     }},
+    {"slip", [](ClosedLoopController &controller, const JsonVariant target) {
+        target["threshold"] = controller.estimator.slipThreshold;
+        target["lag"] = controller.estimator.slipLag;
+        target["count"] = controller.slipCount;
+        target["last"] = controller.slipLast;
+        target["total"] = controller.slipTotal;
+    }},
+    {"encoder", [](ClosedLoopController &controller, const JsonVariant target) {
+        Encoder &encoder = controller.encoder;
+        EncoderQuality &quality = encoder.quality;
+        target["filterSize"] = encoder.filterSize;
+        target["maxRate"] = encoder.maxRate;
+        target["samples"] = quality.samples;
+        target["dropouts"] = quality.dropouts;
+        target["outliers"] = quality.outliers;
+        target["latencyP50"] = quality.getLatencyPercentile(0.5f);
+        target["latencyP95"] = quality.getLatencyPercentile(0.95f);
+        target["latencyP99"] = quality.getLatencyPercentile(0.99f);
+    }},
     {"limits", [](ClosedLoopController &controller, const JsonVariant target) {
         target["enabled"] = controller.hasLimits;
-        target["begin"] = controller.limitA;
-        target["end"] = controller.limitB;
+        target["begin"] = controller.limitA.toDegrees();
+        // equal limits stand for a full turn
+        target["end"] = controller.limitB.toDegrees() + (controller.limitA == controller.limitB ? 360.f : 0.f);
     }},
     {"calibration", [](ClosedLoopController &controller, const JsonVariant target) {
         target["running"].set(controller.calibrationRunning);
@@ -184,11 +267,26 @@ JsonRouter<ClosedLoopController> ClosedLoopControllerJsonRouter::router = JsonRo
         target["steps"].set(controller.calibrationSteps);
         target["speed"].set(controller.calibrationSpeed);
         target["decay"].set(controller.calibrationDecay);
+        target["mode"].set(controller.calibrationMode == CalibrationMode::FOURIER ? "fourier" : "table");
+        target["version"].set(CL_CALIBRATION_VERSION);
+        target["scale"].set(controller.calibrationScale);
+        auto fourier = target["fourier"].to<JsonArray>();
+        copyArray(controller.calibrationFourier, fourier);
+        // offsets are sent in fixed point, see scale
         if (target["offsets"].is<JsonVariant>()) {
             auto array = target["offsets"].to<JsonArray>();
-            copyArray(controller.calibrationOffsets, array);
+            for (int i = 0; i < controller.calibrationSteps; i++) array.add(controller.calibrationOffsets[i]);
         }
     }},
+    {"mode", [](ClosedLoopController &controller, const JsonVariant target) {
+        target.set(controller.mode == ControlMode::PID ? "pid" : "move");
+    }},
+    {"pid", [](ClosedLoopController &controller, const JsonVariant target) {
+        target["kp"] = controller.kp;
+        target["ki"] = controller.ki;
+        target["kd"] = controller.kd;
+        target["integral"] = controller.integral;
+    }},
     {"stepper", [](ClosedLoopController &controller, const JsonVariant target) {
         if (target.is<JsonObject>()) TMC5160ControllerJsonRouter::router.serialize(controller.stepper, target);
     }},
@@ -224,6 +322,7 @@ JsonEventRouter<ClosedLoopController> ClosedLoopControllerJsonRouter::calibratio
     {"enabled", [](JsonVariant content, ClosedLoopController &controller) {
         if (content.is<bool>()) {
             controller.hasCalibration = content.as<bool>();
+            controller.estimator.reset();
             return true;
         }
         else return false;
@@ -236,13 +335,24 @@ JsonEventRouter<ClosedLoopController> ClosedLoopControllerJsonRouter::calibratio
         }
         else return false;
     }},
-    {"offsets", [](JsonVariant content, ClosedLoopController &controller) {
-        if (content.is<JsonArray>()) {
-            auto array = content.as<JsonArray>();
-            if (array.size() == controller.calibrationSteps) {
-                copyArray(array, controller.calibrationOffsets);
-                return true;
-            }
+    {"steps", [](JsonVariant content, ClosedLoopController &controller) {
+        return content.is<int>() && controller.setCalibrationSteps(content.as<int>());
+    }},
+    {"mode", [](JsonVariant content, ClosedLoopController &controller) {
+        if (content.is<String>()) {
+            String mode = content.as<String>();
+            if (mode == "table") controller.calibrationMode = CalibrationMode::TABLE;
+            else if (mode == "fourier") controller.calibrationMode = CalibrationMode::FOURIER;
+            else return false;
+            controller.estimator.reset();
+            return true;
+        }
+        else return false;
+    }},
+    {"fourier", [](JsonVariant content, ClosedLoopController &controller) {
+        if (content.is<JsonArray>() && content.size() == 2 * controller.calibrationHarmonics + 1) {
+            copyArray(content.as<JsonArray>(), controller.calibrationFourier);
+            return true;
         }
         return false;
     }},
@@ -258,20 +368,34 @@ JsonEventRouter<ClosedLoopController> ClosedLoopControllerJsonRouter::limitsRout
     }},
     {"begin", [](JsonVariant content, ClosedLoopController &controller) {
         if (content.is<double>()) {
-            controller.limitA = content.as<double>();
+            controller.limitA = BinaryAngle::fromDegrees(content.as<float>());
             return true;
         }
         else return false;
     }},
     {"end", [](JsonVariant content, ClosedLoopController &controller) {
         if (content.is<double>()) {
-            controller.limitB = content.as<double>();
+            controller.limitB = BinaryAngle::fromDegrees(content.as<float>());
             return true;
         }
         else return false;
     }}
 });
 
+// Version 2 tables are fixed point, see ClosedLoopController::calibrationScale.
+// Older ones hold degrees. Every bin of a loaded table counts as measured.
+bool ClosedLoopControllerJsonRouter::parseOffsets(JsonArray offsets, int version, ClosedLoopController &controller)
+{
+    if (!controller.setCalibrationSteps(offsets.size())) return false;
+    int i = 0;
+    for (JsonVariant offset : offsets) {
+        if (version >= CL_CALIBRATION_VERSION) controller.calibrationOffsets[i++] = constrain(offset.as<int>(), -32767, 32767);
+        else controller.calibrationOffsets[i++] = controller.toFixedOffset(offset.as<float>());
+    }
+    for (int j = 0; j < controller.calibrationSteps; j++) controller.calibrationFilled[j] = true;
+    return true;
+}
+
 void ClosedLoopControllerService::begin() {
     _httpRouterEndpoint.begin();
     _fsPersistence.readFromFS();
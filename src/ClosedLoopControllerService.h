@@ -13,6 +13,9 @@
 #define CL_CONTROLLER_STATE_EVENT "controller"
 #define CL_CONTROLLER_SETTINGS_EVENT "controllersettings"
 #define CL_SETTINGS_FILE "/config/controllerSettings.json"
+// Saved with the calibration table : 2 for fixed point offsets, tables
+// without a version hold float degrees
+#define CL_CALIBRATION_VERSION 2
 
 class ClosedLoopControllerJsonRouter
 {
@@ -40,13 +43,24 @@ public:
     static const void getSaveMap(JsonObject &root) 
     {
         root["calibration"]["enabled"] = true;
+        root["calibration"]["version"] = true;
         root["calibration"]["offsets"] = true;
+        root["calibration"]["mode"] = true;
+        root["calibration"]["fourier"] = true;
         root["limits"]["enabled"] = true;
         root["limits"]["begin"] = true;
         root["limits"]["end"] = true;
         root["enabled"] = true;
         root["invert"] = true;
+        root["slip"]["threshold"] = true;
+        root["slip"]["lag"] = true;
+        root["encoder"]["filterSize"] = true;
+        root["encoder"]["maxRate"] = true;
         root["offset"] = true;
+        root["mode"] = true;
+        root["pid"]["kp"] = true;
+        root["pid"]["ki"] = true;
+        root["pid"]["kd"] = true;
         root["stepper"] = TMC5160ControllerJsonRouter::getSaveMap();
     }
     static const JsonDocument getSaveMap() 
@@ -56,6 +70,7 @@ public:
         getSaveMap(obj);
         return doc;
     }
+    static bool parseOffsets(JsonArray offsets, int version, ClosedLoopController &controller);
     static JsonRouter<ClosedLoopController> router;
     static JsonEventRouter<ClosedLoopController> calibrationRouter;
     static JsonEventRouter<ClosedLoopController> limitsRouter;
@@ -110,7 +125,7 @@ public:
     }
 
     static void readState(ClosedLoopController *controller, JsonObject &root) {
-        root["targetAngle"] = controller->targetAngle;
+        root["targetAngle"] = controller->targetAngle.toDegrees();
         root["curAngle"] = (int)(controller->encoder.angle * 100 + 0.5) / 100.0;
     }
 };
@@ -193,8 +208,8 @@ public:
         root["tolerance"] = controller->tolerance;
         root["enabled"] = controller->enabled;
         root["hasLimits"] = controller->hasLimits;
-        root["limitA"] = controller->limitA;
-        root["limitB"] = controller->limitB;
+        root["limitA"] = controller->limitA.toDegrees();
+        root["limitB"] = controller->limitB.toDegrees();
     }
 };
 
@@ -60,6 +60,10 @@ public:
     char dateStr[16];
     uint32_t sinceLastUpdate;
     bool hasSerial;
+    uint32_t bytesReceived;
+    uint32_t overruns;
+    uint32_t serialErrors;
+    uint32_t failedChecksums;
 
     static void read(GPSState &state, JsonObject &root) {
         root["latitude"] = state.latitude;
@@ -71,6 +75,10 @@ public:
         root["dateStr"] = state.dateStr;
         root["sinceLastUpdate"] = state.sinceLastUpdate;
         root["hasSerial"] = state.hasSerial;
+        root["bytesReceived"] = state.bytesReceived;
+        root["overruns"] = state.overruns;
+        root["serialErrors"] = state.serialErrors;
+        root["failedChecksums"] = state.failedChecksums;
     }
 
     static StateUpdateResult update(JsonObject &root, GPSState &state) {
@@ -111,6 +119,20 @@ public:
             state.hasSerial = root["hasSerial"];
             changed = true;
         }
+        // the byte count alone is not worth an event
+        state.bytesReceived = root["bytesReceived"] | state.bytesReceived;
+        if (root["overruns"].is<uint32_t>() & state.overruns != root["overruns"]) {
+            state.overruns = root["overruns"];
+            changed = true;
+        }
+        if (root["serialErrors"].is<uint32_t>() & state.serialErrors != root["serialErrors"]) {
+            state.serialErrors = root["serialErrors"];
+            changed = true;
+        }
+        if (root["failedChecksums"].is<uint32_t>() & state.failedChecksums != root["failedChecksums"]) {
+            state.failedChecksums = root["failedChecksums"];
+            changed = true;
+        }
         if (changed) return StateUpdateResult::CHANGED;
         else return StateUpdateResult::UNCHANGED;
     }
@@ -125,6 +147,10 @@ public:
         root["dateStr"] = gps->dateStr;
         root["sinceLastUpdate"] = gps->sinceLastUpdate;
         root["hasSerial"] = gps->hasSerial;
+        root["bytesReceived"] = gps->bytesReceived.load();
+        root["overruns"] = gps->overruns.load();
+        root["serialErrors"] = gps->errors.load();
+        root["failedChecksums"] = gps->failedChecksums;
     }
 };
 
@@ -1,4 +1,5 @@
 #include <HeliostatService.h>
+#include <base64.h>
 
 JsonRouter<HeliostatController> HeliostatControllerJsonRouter::router = JsonRouter<HeliostatController>(
 {
@@ -9,11 +10,13 @@ JsonRouter<HeliostatController> HeliostatControllerJsonRouter::router = JsonRout
         return ClosedLoopControllerJsonRouter::router.parse(content, controller.elevationController);
     }},
     {"sourcesMap", [&](JsonVariant content, HeliostatController &controller) {
+        controller.scheduleReaim();
         return updateDirectionsMap(content.as<JsonObject>(), controller.targetsMap);
     }},
     {"currentTarget", [&](JsonVariant content, HeliostatController &controller) {
         if (content.is<String>()) {
             controller.currentTarget = content.as<String>();
+            controller.scheduleReaim();
             return true;
         }
         return false;
@@ -21,6 +24,7 @@ JsonRouter<HeliostatController> HeliostatControllerJsonRouter::router = JsonRout
     {"currentSource", [&](JsonVariant content, HeliostatController &controller) {
         if (content.is<String>()) {
             controller.currentSource = content.as<String>();
+            controller.scheduleReaim();
             return true;
         }
         return false;
@@ -37,6 +41,7 @@ JsonRouter<HeliostatController> HeliostatControllerJsonRouter::router = JsonRout
         return controller.renameTarget(content["oldName"].as<String>(), content["newName"].as<String>());
     }},
     {"set", [&](JsonVariant content, HeliostatController &controller) {
+        controller.scheduleReaim();
         return controller.setTarget(content["name"].as<String>(), content["azimuth"].as<double>(), content["elevation"].as<double>());
     }},
     {"sunTracker", [&](JsonVariant content, HeliostatController &controller) {
@@ -45,10 +50,61 @@ JsonRouter<HeliostatController> HeliostatControllerJsonRouter::router = JsonRout
             if (obj["latitude"].is<double>()) controller.latitude = obj["latitude"].as<double>();
             if (obj["longitude"].is<double>()) controller.longitude = obj["longitude"].as<double>();
             if (obj["getFromGPS"].is<JsonVariant>()) controller.getLocationFromGPS();
+            controller.scheduleReaim();
             return true;
         }
         return false;
     }},
+    {"feedForward", [&](JsonVariant content, HeliostatController &controller) {
+        if (content.is<bool>()) {
+            controller.feedForward = content.as<bool>();
+            controller.scheduleReaim();
+            if (!controller.feedForward) {
+                controller.azimuthController.stopTracking();
+                controller.elevationController.stopTracking();
+            }
+            return true;
+        }
+        return false;
+    }},
+    {"mount", [&](JsonVariant content, HeliostatController &controller) {
+        if (content.is<JsonObject>()) {
+            MountOrientation &mount = controller.mount;
+            mount.set(content["tilt"] | mount.tilt, content["tiltDirection"] | mount.tiltDirection, content["yaw"] | mount.yaw);
+            controller.scheduleReaim();
+            return true;
+        }
+        return false;
+    }},
+    {"pointingModel", [&](JsonVariant content, HeliostatController &controller) {
+        if (content.is<JsonObject>()) {
+            PointingModel &model = controller.pointingModel;
+            if (content["enabled"].is<bool>()) model.enabled = content["enabled"].as<bool>();
+            if (content["forgetting"].is<float>()) model.forgetting = content["forgetting"].as<float>();
+            if (content["reset"].is<JsonVariant>()) model.reset();
+            if (content["parameters"].is<JsonArray>()) {
+                JsonArray parameters = content["parameters"].as<JsonArray>();
+                for (int i = 0; i < PointingModel::size && i < parameters.size(); i++) model.parameters[i] = parameters[i].as<float>();
+            }
+            if (content["observe"].is<JsonVariant>() && !controller.observePointingError()) return false;
+            controller.scheduleReaim();
+            return true;
+        }
+        return false;
+    }},
+    // shared by all the mirrors, see ControlTiming
+    {"controlPeriod", [&](JsonVariant content, HeliostatController &controller) {
+        if (content.is<uint32_t>()) {
+            controller.controlTiming.period = constrain(content.as<uint32_t>(), 1u, 1000u);
+            controller.controlTiming.reset();
+            return true;
+        }
+        return false;
+    }},
+    {"resetStats", [&](JsonVariant content, HeliostatController &controller) {
+        controller.resetStats();
+        return true;
+    }},
     {"longitude", [&](JsonVariant content, HeliostatController &controller) {
         if (content.is<double>()) {
             controller.longitude = content.as<double>();
@@ -68,13 +124,60 @@ JsonRouter<HeliostatController> HeliostatControllerJsonRouter::router = JsonRout
     {"currentSource", [&](HeliostatController &controller, JsonVariant content)  {
         content.set(controller.currentSource);
     }},
+    {"feedForward", [&](HeliostatController &controller, JsonVariant content)  {
+        content.set(controller.feedForward);
+    }},
+    {"mount", [&](HeliostatController &controller, JsonVariant content)  {
+        content["tilt"] = controller.mount.tilt;
+        content["tiltDirection"] = controller.mount.tiltDirection;
+        content["yaw"] = controller.mount.yaw;
+    }},
+    {"pointingModel", [&](HeliostatController &controller, JsonVariant content)  {
+        PointingModel &model = controller.pointingModel;
+        content["enabled"] = model.enabled;
+        content["forgetting"] = model.forgetting;
+        content["observations"] = model.observations;
+        content["residualRMS"] = model.getResidualRMS();
+        JsonArray parameters = content["parameters"].to<JsonArray>();
+        for (int i = 0; i < PointingModel::size; i++) parameters.add(model.parameters[i]);
+    }},
+    {"scheduler", [&](HeliostatController &controller, JsonVariant content)  {
+        content["interval"] = controller.reaimInterval;
+        content["executed"] = controller.reaimsExecuted;
+        content["skipped"] = controller.reaimsSkipped;
+        content["moveDuration"] = controller.moveDuration;
+    }},
     {"sunTracker", [&](HeliostatController &controller, JsonVariant content) {
         JsonObject obj = content.to<JsonObject>();
         obj["latitude"] = controller.latitude;
         obj["longitude"] = controller.longitude;
         obj["isTimeSet"] = controller.isTimeSet();
-        obj["azimuth"] = controller.getSolarPosition().azimuth;
-        obj["elevation"] = controller.getSolarPosition().elevation;
+        SphericalCoordinate sun = controller.getSolarPosition();
+        obj["azimuth"] = sun.azimuth;
+        obj["elevation"] = sun.elevation;
+    }},
+    {"controlPeriod", [&](HeliostatController &controller, JsonVariant content)  {
+        content.set(controller.controlTiming.period);
+    }},
+    {"control", [&](HeliostatController &controller, JsonVariant content)  {
+        ControlTiming &timing = controller.controlTiming;
+        uint32_t intervals = timing.ticks > 1 ? timing.ticks - 1 : 0;
+        content["ticks"] = timing.ticks;
+        content["meanPeriodMicros"] = intervals > 0 ? double(timing.periodMicros) / intervals : 0.;
+        content["minPeriodMicros"] = intervals > 0 ? timing.periodMinMicros : 0;
+        content["maxPeriodMicros"] = timing.periodMaxMicros;
+        content["meanJitterMicros"] = intervals > 0 ? double(timing.jitterMicros) / intervals : 0.;
+        content["maxJitterMicros"] = timing.jitterMaxMicros;
+    }},
+    {"stats", [&](HeliostatController &controller, JsonVariant content)  {
+        content["ticks"] = controller.loopTicks;
+        content["meanMicros"] = controller.loopTicks > 0 ? double(controller.loopMicros) / controller.loopTicks : 0.;
+        content["maxMicros"] = controller.loopMaxMicros;
+        content["commands"] = controller.getCommandCount();
+        content["azimuthMaxError"] = controller.azimuthController.errorMax;
+        content["azimuthRMSError"] = controller.azimuthController.getErrorRMS();
+        content["elevationMaxError"] = controller.elevationController.errorMax;
+        content["elevationRMSError"] = controller.elevationController.getErrorRMS();
     }},
     {"azimuth", [&](HeliostatController &controller, JsonVariant content) {
         if (content.is<JsonObject>()) ClosedLoopControllerJsonRouter::router.serialize(controller.azimuthController, content);
@@ -130,10 +233,138 @@ void HeliostatService::begin()
     _eventEndpoint.begin();
     _httpRouterEndpoint.begin();
     _fsPersistence.readFromFS();
+    _socket->registerEvent(HELIOSTAT_SLIP_EVENT);
+    _socket->registerEvent(HELIOSTAT_TELEMETRY_EVENT);
     _state.init();
+    _services.push_back(this);
 }
+
+std::vector<HeliostatService *> HeliostatService::_services;
+TaskHandle_t HeliostatService::_controlTask = nullptr;
+TaskHandle_t HeliostatService::_telemetryTask = nullptr;
+
+// The service list is fixed from here on, the tasks iterate it unlocked
+void HeliostatService::startTasks()
+{
+    if (_controlTask != nullptr || _services.empty()) return;
+    xTaskCreatePinnedToCore(
+        _controlLoop,               // Function that should be called
+        "Heliostat Control",        // Name of the task (for debugging)
+        8192,                       // Stack size (bytes)
+        NULL,                       // All the services
+        (configMAX_PRIORITIES - 2), // above the loop and the web server
+        &_controlTask,              // Task handle
+        HELIOSTAT_CONTROL_CORE      // Pin to application core
+    );
+    xTaskCreatePinnedToCore(
+        _telemetryLoop,             // Function that should be called
+        "Heliostat Telemetry",      // Name of the task (for debugging)
+        4096,                       // Stack size (bytes)
+        NULL,                       // All the services
+        (tskIDLE_PRIORITY + 1),     // below the control task
+        &_telemetryTask,            // Task handle
+        tskNO_AFFINITY              // Any core
+    );
+}
+
+// The controllers are driven from the control task only, loop() is kept for
+// when the task could not be created
 void HeliostatService::loop() 
 {
-    _state.run();
+    if (_controlTask == nullptr) _state.run();
     // _stateService.updateState();
-}
\ No newline at end of file
+}
+
+// Slips are recorded by the control task, the events are sent from here
+void HeliostatService::emitSlips(const char *axis, ClosedLoopController &controller, uint32_t &cursor)
+{
+    SlipEvent event;
+    while (controller.slipEvents.from(cursor, &event, 1) > 0) {
+        JsonDocument doc;
+        doc["heliostat"] = _name;
+        doc["axis"] = axis;
+        doc["slip"] = event.slip;
+        doc["count"] = event.count;
+        doc["time"] = event.time;
+        JsonObject jsonObject = doc.as<JsonObject>();
+        _socket->emitEvent(HELIOSTAT_SLIP_EVENT, jsonObject);
+    }
+}
+
+void HeliostatService::runControl()
+{
+    // the transaction keeps REST and socket updates out of a control step
+    beginTransaction();
+    _state.run();
+    endTransaction();
+}
+
+// The mirrors run one after the other every control period, the driver SPI
+// pins and the step generator are shared. The encoders sample on a bus of
+// their own. The wake-up is timed before any mirror runs or waits on a lock.
+void HeliostatService::_controlLoop(void *)
+{
+    ControlTiming &timing = ControlTiming::shared();
+    TickType_t xLastWakeTime = xTaskGetTickCount();
+    while (1)
+    {
+        timing.record(micros());
+        for (HeliostatService *service : _services) service->runControl();
+        TickType_t ticks = pdMS_TO_TICKS(timing.period);
+        vTaskDelayUntil(&xLastWakeTime, ticks > 0 ? ticks : 1);
+    }
+}
+
+// Streams the records sampled by the control task, which never waits on the
+// socket. Each frame is a run of consecutive records starting at index.
+void HeliostatService::emitTelemetry(const char *axis, TMCTelemetry &telemetry)
+{
+    TelemetryRecord records[32];
+    int count;
+    while ((count = telemetry.next(records, 32)) > 0) {
+        JsonDocument doc;
+        doc["heliostat"] = _name;
+        doc["axis"] = axis;
+        doc["index"] = telemetry.getCursor() - count;
+        doc["period"] = telemetry.period;
+        doc["records"] = base64::encode((uint8_t *)records, count * sizeof(TelemetryRecord));
+        JsonObject jsonObject = doc.as<JsonObject>();
+        _socket->emitEvent(HELIOSTAT_TELEMETRY_EVENT, jsonObject);
+    }
+}
+
+void HeliostatService::readTelemetry(JsonObject &root)
+{
+    uint32_t now = millis();
+    JsonObject telemetry = root["telemetry"][_name].to<JsonObject>();
+    TMCTelemetry *axes[] = {&_state.azimuthController.stepper.telemetry, &_state.elevationController.stepper.telemetry};
+    const char *names[] = {"azimuth", "elevation"};
+    for (int i = 0; i < 2; i++) {
+        TelemetrySummary summary = axes[i]->summarize(HELIOSTAT_TELEMETRY_WINDOW, now);
+        JsonObject axis = telemetry[names[i]].to<JsonObject>();
+        axis["samples"] = summary.count;
+        axis["loadMin"] = summary.loadMin;
+        axis["loadMax"] = summary.loadMax;
+        axis["loadMean"] = summary.loadMean;
+        axis["currentMin"] = summary.currentMin;
+        axis["currentMax"] = summary.currentMax;
+        axis["currentMean"] = summary.currentMean;
+        axis["flags"] = summary.flags;
+        axis["dropped"] = axes[i]->dropped;
+    }
+}
+
+void HeliostatService::_telemetryLoop(void *)
+{
+    TickType_t xLastWakeTime = xTaskGetTickCount();
+    while (1)
+    {
+        for (HeliostatService *service : _services) {
+            service->emitSlips("azimuth", service->_state.azimuthController, service->_slipCursors[0]);
+            service->emitSlips("elevation", service->_state.elevationController, service->_slipCursors[1]);
+            service->emitTelemetry("azimuth", service->_state.azimuthController.stepper.telemetry);
+            service->emitTelemetry("elevation", service->_state.elevationController.stepper.telemetry);
+        }
+        vTaskDelayUntil(&xLastWakeTime, pdMS_TO_TICKS(HELIOSTAT_TELEMETRY_PERIOD));
+    }
+}
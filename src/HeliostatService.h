@@ -10,6 +10,17 @@
 
 #include <esp_debug_helpers.h>
 
+#define HELIOSTAT_SLIP_EVENT "slip"
+#define HELIOSTAT_TELEMETRY_EVENT "telemetry"
+
+// ms between telemetry frames, and the summary window of the analytics
+#define HELIOSTAT_TELEMETRY_PERIOD 100
+#define HELIOSTAT_TELEMETRY_WINDOW 2000
+
+#ifndef HELIOSTAT_CONTROL_CORE
+#define HELIOSTAT_CONTROL_CORE CONFIG_ARDUINO_RUNNING_CORE
+#endif
+
 class HeliostatControllerJsonRouter
 {
 public:
@@ -41,6 +52,13 @@ public:
         root["azimuth"] = ClosedLoopControllerJsonRouter::getSaveMap();
         root["currentTarget"] = true;
         root["currentSource"] = true;
+        root["feedForward"] = true;
+        root["mount"]["tilt"] = true;
+        root["mount"]["tiltDirection"] = true;
+        root["mount"]["yaw"] = true;
+        root["pointingModel"]["enabled"] = true;
+        root["pointingModel"]["forgetting"] = true;
+        root["pointingModel"]["parameters"] = true;
         root["sourcesMap"] = true;
         root["sunTracker"]["latitude"] = true;
         root["sunTracker"]["longitude"] = true;
@@ -58,26 +76,57 @@ public:
     static JsonRouter<HeliostatController> router;
 };
 
+// One service per mirror, named after its REST path, socket event and config
+// file. All the mirrors of a board are driven by one control task and one
+// telemetry task, started once every service has begun.
 class HeliostatService : public StatefulService<HeliostatController&>
 {
+    // declared first, the endpoints keep pointers to them
+    String _name;
+    String _restPath;
+    String _eventName;
+    String _filePath;
+
 public:
     HeliostatService(PsychicHttpServer *server,
                         EventSocket *socket,
                         FS *fs,
                         SecurityManager *securityManager,
-                        HeliostatController &controller) :
-                            _httpRouterEndpoint(_router.read, _router.update, this, server, "/rest/heliostat", securityManager),
-                            _eventEndpoint(_router.read, _router.update, this, socket, "heliostat-service"),
-                            _fsPersistence(_router.readForSave, _router.update, this, fs, "/config/heliostat.json"),
+                        HeliostatController &controller,
+                        String name = "heliostat") :
+                            _name(name),
+                            _restPath("/rest/" + name),
+                            _eventName(name + "-service"),
+                            _filePath("/config/" + name + ".json"),
+                            _httpRouterEndpoint(_router.read, _router.update, this, server, _restPath.c_str(), securityManager),
+                            _eventEndpoint(_router.read, _router.update, this, socket, _eventName.c_str()),
+                            _fsPersistence(_router.readForSave, _router.update, this, fs, _filePath.c_str()),
+                            _socket(socket),
                             StatefulService(controller) {}
     void begin();
     void loop();
+    void readTelemetry(JsonObject &root);
+    static void startTasks();
 
 private:
     EventEndpoint<HeliostatController&> _eventEndpoint;
     HttpRouterEndpoint<HeliostatController&> _httpRouterEndpoint;
     FSPersistence<HeliostatController&> _fsPersistence;
     HeliostatControllerJsonRouter _router;
+    EventSocket *_socket;
+    // next slip event to send, azimuth and elevation
+    uint32_t _slipCursors[2] = {0, 0};
+
+    static std::vector<HeliostatService *> _services;
+    static TaskHandle_t _controlTask;
+    static TaskHandle_t _telemetryTask;
+
+    void runControl();
+    void emitSlips(const char *axis, ClosedLoopController &controller, uint32_t &cursor);
+    void emitTelemetry(const char *axis, TMCTelemetry &telemetry);
+
+    static void _controlLoop(void *);
+    static void _telemetryLoop(void *);
 };
 
 // class HeliostatControllerState
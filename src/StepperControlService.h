@@ -83,7 +83,7 @@ public:
         // Serial.println(float(root["speed"]));
         root["acceleration"] = stepper->getAcceleration();
         root["status"] = stepper->getStatus();
-        root["version"] = stepper->driver.version();
+        root["version"] = stepper->registers.getVersion();
         // Serial.println(stepper->getStatus());
     }
 };
@@ -9,25 +9,47 @@ JsonRouter<TMC5160Controller> TMC5160ControllerJsonRouter::router = JsonRouter<T
     {"control", [](JsonVariant content, TMC5160Controller &controller) {
         return controlRouter.parse(content, controller);
     }},
+    {"telemetry", [](JsonVariant content, TMC5160Controller &controller) {
+        if (content.is<JsonObject>()) {
+            controller.telemetry.period = content["period"] | controller.telemetry.period;
+            return true;
+        }
+        else return false;
+    }},
 },
 {
     {"control", [](TMC5160Controller &controller, const JsonVariant target) {
-        target["speed"] = controller.getSpeed();
+        target["speed"] = controller.getCachedSpeed();
         target["accel"] = controller.getAcceleration();
         target["move"] = 0.;
     }},
     {"diag", [](TMC5160Controller &controller, const JsonVariant target) {
         target["isEnabled"] = controller.isEnabled();
         target["status"] = controller.getStatus();
-        target["version"] = controller.driver.version();
+        target["version"] = controller.registers.getVersion();
+        target["spiTransactions"] = controller.registers.spiTransactions;
+        target["commands"] = controller.commandCount;
+    }},
+    {"telemetry", [](TMC5160Controller &controller, const JsonVariant target) {
+        TelemetryRecord record;
+        target["period"] = controller.telemetry.period;
+        target["samples"] = controller.telemetry.ring.size();
+        target["dropped"] = controller.telemetry.dropped;
+        if (controller.telemetry.ring.latest(record)) {
+            target["load"] = record.load;
+            target["current"] = record.current;
+            target["flags"] = record.flags;
+        }
     }},
     {"config", [](TMC5160Controller &controller, const JsonVariant target) {
         target["enabled"] = controller.isEnabled();
         target["maxSpeed"] = controller.maxSpeed;
         target["maxAccel"] = controller.maxAccel;
-        target["invertDirection"] = controller.driver.shaft();
-        target["driverCurrent"] = controller.driver.rms_current();
+        target["maxJerk"] = controller.maxJerk;
+        target["invertDirection"] = controller.registers.getShaft();
+        target["driverCurrent"] = controller.registers.getRmsCurrent();
         target["stepsPerRot"] = controller.stepsPerRotation;
+        target["backend"] = controller.isInternal() ? "internal" : "stepdir";
     }}
 });
 
@@ -56,7 +78,7 @@ JsonEventRouter<TMC5160Controller> TMC5160ControllerJsonRouter::controlRouter =
     }},
     {"move", [](JsonVariant content, TMC5160Controller &controller) {
         if (content.is<double>()) {
-            controller.setMaxSpeed();
+            controller.clearRamp();
             controller.moveR(content.as<double>());
             return true;
         }
@@ -79,13 +101,22 @@ JsonEventRouter<TMC5160Controller> TMC5160ControllerJsonRouter::configRouter = J
     {"maxAccel", [](JsonVariant content, TMC5160Controller &controller) {
         if (content.is<double>()) {
             controller.maxAccel = content.as<double>();
+            controller.setAcceleration(controller.acceleration);
+            return true;
+        }
+        else return false;
+    }},
+    {"maxJerk", [](JsonVariant content, TMC5160Controller &controller) {
+        if (content.is<double>()) {
+            controller.maxJerk = content.as<double>();
+            controller.setAcceleration(controller.acceleration);
             return true;
         }
         else return false;
     }},
     {"driverCurrent", [](JsonVariant content, TMC5160Controller &controller) {
         if (content.is<double>()) {
-            controller.driver.rms_current(content.as<double>());
+            controller.registers.setRmsCurrent(content.as<double>());
             return true;
         }
         else return false;
@@ -100,7 +131,7 @@ JsonEventRouter<TMC5160Controller> TMC5160ControllerJsonRouter::configRouter = J
     }},
     {"invertDirection", [](JsonVariant content, TMC5160Controller &controller) {
         if (content.is<bool>()) {
-            controller.driver.shaft(content.as<bool>());
+            controller.registers.setShaft(content.as<bool>());
             return true;
         }
         else return false;
@@ -112,6 +143,15 @@ JsonEventRouter<TMC5160Controller> TMC5160ControllerJsonRouter::configRouter = J
         }
         else return false;
     }},
+    {"backend", [](JsonVariant content, TMC5160Controller &controller) {
+        if (content.is<String>()) {
+            String backend = content.as<String>();
+            if (backend == "stepdir") return controller.setBackend(StepBackend::STEPDIR);
+            else if (backend == "internal") return controller.setBackend(StepBackend::INTERNAL);
+            else return false;
+        }
+        else return false;
+    }},
 });
 
 void StepperService::begin() {
@@ -37,8 +37,11 @@ public:
         root["config"]["invertDirection"] = true;
         root["config"]["maxSpeed"] = true;
         root["config"]["maxAccel"] = true;
+        root["config"]["maxJerk"] = true;
         root["config"]["stepsPerRot"] = true;
         root["config"]["driverCurrent"] = true;
+        root["config"]["backend"] = true;
+        root["telemetry"]["period"] = true;
     }
     static const JsonDocument getSaveMap() 
     {
@@ -52,11 +52,11 @@ void StepperSettingsService::onConfigUpdated()
 {
     for (int i = 0; i < _steppers.size(); i++) {        
         auto settings = _state.settings[i];
-        auto stepper = *_steppers[i];
+        auto &stepper = *_steppers[i];
         stepper.maxSpeed = settings.maxSpeed;
         stepper.maxAccel = settings.maxAcceleration;
-        stepper.driver.rms_current(settings.current);
-        stepper.driver.shaft(settings.invertDirection);
+        stepper.registers.setRmsCurrent(settings.current);
+        stepper.registers.setShaft(settings.invertDirection);
     }
 }
 
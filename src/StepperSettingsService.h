@@ -42,10 +42,10 @@ public:
     }
 
     static void readState(TMC5160Controller &stepper, JsonObject &root) {
-        root["invertDirection"] = stepper.driver.shaft();
+        root["invertDirection"] = stepper.registers.getShaft();
         root["maxSpeed"] = stepper.getMaxSpeed();
         root["maxAcceleration"] = stepper.getAcceleration();
-        root["current"] = stepper.driver.rms_current();
+        root["current"] = stepper.registers.getRmsCurrent();
     }
 };
 
@@ -0,0 +1,72 @@
+#ifndef BINARY_ANGLE_H
+#define BINARY_ANGLE_H
+
+#include <stdint.h>
+
+// Binary angle : a full turn is mapped onto the uint32 range, so wrapping to
+// [0, 360) is plain integer overflow and the signed difference of two angles
+// is the shortest angular distance, with no floor() and no rounding drift.
+// Resolution is 360 / 2^32 ≈ 8.4e-8°.
+struct BinaryAngle
+{
+    uint32_t value = 0;
+
+    BinaryAngle() {}
+    explicit BinaryAngle(uint32_t value) : value(value) {}
+
+    static BinaryAngle fromDegrees(float degrees) {
+        // only float to int32 truncations, which the FPU does in one instruction
+        float turns = degrees * (1.f / 360.f);
+        turns -= int32_t(turns);
+        return BinaryAngle{uint32_t(int32_t(turns * 2147483648.f)) << 1};
+    }
+    // Raw reading of a sensor with the given resolution in bits
+    static BinaryAngle fromRaw(uint32_t raw, int bits) {
+        return BinaryAngle{raw << (32 - bits)};
+    }
+    // Reading of a sensor with any number of counts per turn
+    static BinaryAngle fromCounts(uint32_t counts, uint32_t countsPerTurn) {
+        return BinaryAngle{uint32_t((uint64_t(counts) << 32) / countsPerTurn)};
+    }
+    float toDegrees() const {
+        return value * (360.f / 4294967296.f);
+    }
+    // In [-180, 180)
+    float toSignedDegrees() const {
+        return int32_t(value) * (360.f / 4294967296.f);
+    }
+    // Signed shortest distance from b to this angle
+    int32_t distance(BinaryAngle b) const {
+        return int32_t(value - b.value);
+    }
+    float distanceDegrees(BinaryAngle b) const {
+        return BinaryAngle{value - b.value}.toSignedDegrees();
+    }
+    // Bin index and position within the bin for a table of 2^bits entries
+    uint32_t index(int bits) const {
+        return value >> (32 - bits);
+    }
+    float fraction(int bits) const {
+        return (value << bits) * (1.f / 4294967296.f);
+    }
+    BinaryAngle operator+(BinaryAngle const& obj) const {
+        return BinaryAngle{value + obj.value};
+    }
+    BinaryAngle operator-(BinaryAngle const& obj) const {
+        return BinaryAngle{value - obj.value};
+    }
+    BinaryAngle operator-() const {
+        return BinaryAngle{0u - value};
+    }
+    BinaryAngle operator+(int32_t const& obj) const {
+        return BinaryAngle{value + uint32_t(obj)};
+    }
+    bool operator==(BinaryAngle const& obj) const {
+        return value == obj.value;
+    }
+    bool operator!=(BinaryAngle const& obj) const {
+        return value != obj.value;
+    }
+};
+
+#endif
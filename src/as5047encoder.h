@@ -0,0 +1,47 @@
+#ifndef AS5047_ENCODER_H
+#define AS5047_ENCODER_H
+
+#include <encoder.h>
+#include <SPI.h>
+
+// AS5047 class 14 bit magnetic encoder on SPI. A read takes two 16 bit
+// frames of a few µs, so it can be sampled every millisecond.
+class AS5047Encoder : public Encoder
+{
+public:
+    AS5047Encoder(int CS, int SCK, int MISO, int MOSI, SPIClass &spi_ = SPI) :
+        Encoder(1 << 14), CS(CS), SCK(SCK), MISO(MISO), MOSI(MOSI), spi(spi_) {}
+
+    void begin() override {
+        pinMode(CS, OUTPUT);
+        digitalWrite(CS, HIGH);
+        spi.begin(SCK, MISO, MOSI, CS);
+    }
+
+    int readEncoder() override {
+        // the answer to a command comes with the next frame
+        transfer(readAngle);
+        uint16_t frame = transfer(nop);
+        // even parity over the frame, bit 14 flags a command error
+        if (__builtin_parity(frame) != 0 || (frame & 0x4000)) return -1;
+        return frame & 0x3FFF;
+    }
+
+private:
+    static const uint16_t readAngle = 0xFFFF;    // ANGLECOM with read and parity bits
+    static const uint16_t nop = 0xC000;
+    uint16_t transfer(uint16_t command) {
+        spi.beginTransaction(SPISettings(10000000, MSBFIRST, SPI_MODE1));
+        digitalWrite(CS, LOW);
+        uint16_t frame = spi.transfer16(command);
+        digitalWrite(CS, HIGH);
+        spi.endTransaction();
+        return frame;
+    }
+    const int CS;
+    const int SCK;
+    const int MISO;
+    const int MOSI;
+    SPIClass &spi;
+};
+#endif
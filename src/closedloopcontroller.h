@@ -4,6 +4,25 @@
 #include <Arduino.h>
 #include <tmcdriver.h>
 #include <encoder.h>
+#include <angle.h>
+#include <estimator.h>
+#include <pathplanner.h>
+#include <geometry.h>
+#include <bitset>
+
+enum class CalibrationMode {TABLE, FOURIER};
+
+// MOVE issues a positioning move for any error above the tolerance, PID
+// drives the stepper velocity from the position error
+enum class ControlMode {MOVE, PID};
+
+// Resync of the stepper count, slip in ° and slipCount after it
+struct SlipEvent
+{
+    uint32_t time;
+    float slip;
+    uint32_t count;
+};
 
 class ClosedLoopController
 {
@@ -11,61 +30,158 @@ public:
     TMC5160Controller &stepper;
     Encoder &encoder;
     uint32_t maxPollInterval = 50;
+    uint32_t settledPollInterval = 500;
+    // set by the heliostat scheduler, a settled axis then waits up to the
+    // next re-aim; 0 keeps settledPollInterval
+    uint32_t scheduledPollInterval = 0;
     bool enabled;
-    double targetAngle;
-    double tolerance = 0.1;
-    double encoderOffset = 0.;
-    double error;
-    double limitA = 0.;
-    double limitB = 360.;
-    double calibrationDecay = 0.1;
+    // Positions are binary angles, see angle.h. Equal limits mean a full turn.
+    BinaryAngle targetAngle;
+    float tolerance = 0.1f;
+    BinaryAngle encoderOffset;
+    float error = 0.f;
+    BinaryAngle limitA;
+    BinaryAngle limitB;
+    float calibrationDecay = 0.1f;
     int calibrationSpeed = 5;
     bool hasLimits = false;
     bool hasCalibration = false;
     bool calibrationRunning = false;
-    static const int calibrationSteps = 128;
-    float calibrationOffsets[calibrationSteps];
-    double calibrationStepperStartOffset = 0.;
+    bool tracking = false;
+    float trackingGain = 0.2f;
+    float trackingWindow = 2.f;
+    float velocityDeadband = 0.0005f;
+    ControlMode mode = ControlMode::MOVE;
+    // PID gains, output in °/s for an error in °
+    float kp = 2.f;
+    float ki = 0.2f;
+    float kd = 0.f;
+    float integral = 0.f;
+    AxisEstimator estimator;
+    // estimated angle and rate for the service readers, refreshed by run()
+    // with the stepper status so the readers never touch a bus
+    float cachedAngle = 0.f;
+    float cachedRate = 0.f;
+    // last planned path, for diagnostics
+    AxisPath path;
+    // Lost steps found by the estimator, the stepper count is shifted back in
+    // line with the encoder so the next move starts from the true position.
+    // Each resync is recorded in slipEvents for the telemetry task.
+    uint32_t slipCount = 0;
+    float slipLast = 0.f;
+    float slipTotal = 0.f;
+    SampleRing<SlipEvent, 8> slipEvents;
+    float errorMax = 0.f;
+    float errorSumSq = 0.f;
+    uint32_t errorSamples = 0;
+    // Calibration offsets in fixed point, interpolated over the first
+    // 2^calibrationBits bins, or a Fourier series of the same error fitted
+    // alongside. Sized for the largest table so resizing never allocates.
+    static const int maxCalibrationBits = 10;
+    static const int maxCalibrationSteps = 1 << maxCalibrationBits;
+    static constexpr float calibrationScale = 0.001f;
+    static const int calibrationHarmonics = 4;
+    int calibrationBits = 7;
+    int calibrationSteps = 1 << 7;
+    int16_t calibrationOffsets[maxCalibrationSteps] = {};
+    // bins that hold a measurement, a zero offset is a valid one
+    std::bitset<maxCalibrationSteps> calibrationFilled;
+    CalibrationMode calibrationMode = CalibrationMode::TABLE;
+    // a0, a1, b1, a2, b2... fitted by LMS, a low rate averages over sweeps
+    float calibrationFourier[2 * calibrationHarmonics + 1] = {};
+    float fourierRate = 0.01f;
+    float calibrationStepperStartOffset = 0.f;
     ClosedLoopController(TMC5160Controller &stepper, Encoder &encoder) : stepper(stepper), encoder(encoder) {}
-    double mod(double a, double N) {return a - N*floor(a/N);}
-    double angularDistance(double a, double b) {
-        return mod(a - b + 180., 360.) - 180.;
+    // Angle math runs in single precision, the ESP32 FPU has no double support
+    float mod(float a, float N) {return a - N*floorf(a/N);}
+    float angularDistance(float a, float b) {
+        return BinaryAngle::fromDegrees(a).distanceDegrees(BinaryAngle::fromDegrees(b));
+    }
+    void setAngle(float angle) {
+        setAngle(BinaryAngle::fromDegrees(angle));
     }
-    void setAngle(double angle) {
+    void setAngle(BinaryAngle angle) {
+        stopTracking();
         targetAngle = angle;
-        double curAngle = getAngle();
+        rampPlanned = false;
+        runMove();
+    }
+    // Move along a profile from planMove(), kept until the target is reached
+    void setAngle(BinaryAngle angle, SCurveProfile profile) {
+        stopTracking();
+        targetAngle = angle;
+        ramp = profile;
+        rampPlanned = true;
+        runMove();
+    }
+    SCurveProfile planMove(BinaryAngle angle) {
+        stopTracking();
+        targetAngle = angle;
+        updateError();
+        return SCurveProfile::plan(error, stepper.getMaxVelocity(), stepper.getMaxAcceleration(), stepper.getMaxJerk());
+    }
+    // Follow a target moving at a constant angular velocity (°/s). The stepper
+    // runs continuously at the feed-forward velocity, the encoder error only
+    // trims it. Errors beyond trackingWindow fall back to a positioning move.
+    void setTrajectory(float angle, float velocity) {
+        trajectoryAngle = BinaryAngle::fromDegrees(angle);
+        trajectoryVelocity = velocity;
+        trajectoryStart = millis();
+        if (!tracking) commandedVelocity = NAN;
+        tracking = true;
+    }
+    bool updateError() {
+        BinaryAngle curAngle = getPosition();
         if (encoder.hasNewData()) {
-            if (hasLimits) {
-                double middle = mod((limitA + limitB) * 0.5, 360.);
-                double interval = limitB - limitA;
-                if (limitB < limitA) {
-                    middle = mod(middle + 180., 360.);
-                    interval = mod(interval, 360.);
-                }
-                double t = mod(targetAngle - middle + 180., 360.) - 180.;
-                targetAngle = mod(max(min(t, interval*0.5), -interval*0.5) + middle, 360.);
-                error = mod(targetAngle - middle + 180., 360.) - mod(curAngle - middle + 180., 360.);
-                // ESP_LOGI("Controller", "Middle : %f`, Interval: %f, t: %f, Target: %f, To Go: %f\n", middle, interval, t, targetAngle, error);
-            }
-            else error = mod(targetAngle - curAngle + 180., 360.) - 180.;
-            // ESP_LOGI("Controller", "Command : %f, Target: %f, Current: %f, To Go: %f\n", angle, targetAngle, curAngle, error);
-            if (abs(error) > tolerance && enabled) {
-                stepper.setMaxSpeed();
-                stepper.moveR(error);
+            if (hasLimits && limitA != limitB) {
+                path = AxisPath::plan(curAngle, targetAngle, limitA, limitB);
+                targetAngle = limitA + BinaryAngle{path.end};
             }
+            else path = AxisPath::plan(curAngle, targetAngle);
+            targetClamped = path.clamped;
+            error = path.getTravel();
+            // ESP_LOGI("Controller", "Target: %f, Current: %f, To Go: %f\n", targetAngle.toDegrees(), curAngle.toDegrees(), error);
+            estimator.correct(stepper.getPosition(), curAngle, millis(), stepper.getVelocity());
+            if (estimator.slipping && !calibrationRunning) resyncSlip();
+            errorMax = max(errorMax, abs(error));
+            errorSumSq += error * error;
+            errorSamples++;
+            return true;
         }
+        return false;
+    }
+    float getAngle(){
+        return getPosition().toDegrees();
+    }
+    BinaryAngle getPosition(){
+        if (hasCalibration) return getCalibratedPosition();
+        else return encoder.getPosition() + encoderOffset;
     }
-    double getAngle(){
-        if (hasCalibration) return getCalibratedAngle();
-        else return mod(encoder.getAngle()+encoderOffset, 360.);
+    // Fused estimate, reads no sensor once the estimator has an encoder sample
+    BinaryAngle getEstimatedPosition() {
+        if (!estimator.valid) return getPosition();
+        estimator.predict(millis());
+        return estimator.getPosition(stepper.getPosition());
     }
-    double lerp(double a, double b, double t) {
-        return b * t + a * (1. - t);
+    float getEstimatedAngle() {
+        return getEstimatedPosition().toDegrees();
+    }
+    float getRate() {
+        return stepper.getVelocity();
+    }
+    float lerp(float a, float b, float t) {
+        return b * t + a * (1.f - t);
     }
     void run() {
+        if (stepper.sampleStatus()) {
+            cachedAngle = estimator.valid ? estimator.getPosition(stepper.getCachedPosition()).toDegrees() : getAngle();
+            cachedRate = stepper.getCachedVelocity();
+        }
         if (calibrationRunning) runCalibration();
-        else if (enabled && millis() - lastPoll >= maxPollInterval) {
-            setAngle(targetAngle);
+        else if (enabled && millis() - lastPoll >= (isSettled() ? max(settledPollInterval, scheduledPollInterval) : maxPollInterval)) {
+            if (tracking) runTracking();
+            else if (mode == ControlMode::PID) runPid();
+            else runMove();
             lastPoll = millis();
         }
     }
@@ -73,62 +189,192 @@ public:
         if (!calibrationRunning) {
             calibrationStepperStartOffset = angularDistance(stepper.getAngle(), encoder.getAngle());
             stepper.setSpeed(calibrationSpeed);
-            if (hasLimits) setAngle(limitA);
             calibrationRunning = true;
+            if (hasLimits) setAngle(limitA);
+        }
+    }
+    float getErrorRMS() {
+        return errorSamples > 0 ? sqrtf(errorSumSq / errorSamples) : 0.f;
+    }
+    void resetErrorStats() {
+        errorMax = 0.f;
+        errorSumSq = 0.f;
+        errorSamples = 0;
+    }
+    void setMode(ControlMode newMode) {
+        if (newMode == mode) return;
+        stopTracking();
+        stepper.stop();
+        mode = newMode;
+        resetPid();
+    }
+    void resetPid() {
+        integral = 0.f;
+        previousError = NAN;
+        commandedVelocity = NAN;
+    }
+    void stopTracking() {
+        if (tracking) {
+            tracking = false;
+            stepper.stop();
+            commandedVelocity = NAN;
         }
     }
     void stopCalibration() {
         if (calibrationRunning) {
             stepper.stop();
             calibrationRunning = false;
+            resetPid();
         }
     }
     void resetCalibration() {
-        for (int i = 0; i < calibrationSteps; i++) {
-            calibrationOffsets[i] = 0.;
+        std::fill(std::begin(calibrationOffsets), std::end(calibrationOffsets), 0);
+        calibrationFilled.reset();
+        std::fill(std::begin(calibrationFourier), std::end(calibrationFourier), 0.f);
+    }
+    // steps is a power of two from 8 to 1024, changing it clears the table
+    bool setCalibrationSteps(int steps) {
+        if (steps < 8 || steps > maxCalibrationSteps || (steps & (steps - 1)) != 0) return false;
+        if (steps != calibrationSteps) {
+            calibrationSteps = steps;
+            calibrationBits = 31 - __builtin_clz(steps);
+            std::fill(std::begin(calibrationOffsets), std::end(calibrationOffsets), 0);
+            calibrationFilled.reset();
+            estimator.reset();
+        }
+        return true;
+    }
+    static int16_t toFixedOffset(float offset) {
+        return constrain(lroundf(offset / calibrationScale), -32767L, 32767L);
+    }
+    float getCalibrationOffset(BinaryAngle rawAngle) {
+        if (calibrationMode == CalibrationMode::FOURIER) return getFourierOffset(rawAngle);
+        uint32_t index = rawAngle.index(calibrationBits);
+        float current = calibrationOffsets[index];
+        float next = calibrationOffsets[(index + 1) & (calibrationSteps - 1)];
+        return lerp(current, next, rawAngle.fraction(calibrationBits)) * calibrationScale;
+    }
+    float getFourierOffset(BinaryAngle rawAngle) {
+        float theta = degToRad(rawAngle.toDegrees());
+        float s1 = sinf(theta), c1 = cosf(theta);
+        float s = s1, c = c1;
+        float offset = calibrationFourier[0];
+        for (int k = 1; k <= calibrationHarmonics; k++) {
+            offset += calibrationFourier[2 * k - 1] * c + calibrationFourier[2 * k] * s;
+            // next harmonic by angle addition
+            float cNext = c * c1 - s * s1;
+            s = s * c1 + c * s1;
+            c = cNext;
         }
+        return offset;
     }
     void setCalibrationSpeed(int speed) {
         calibrationSpeed = speed;
         if (calibrationRunning) stepper.setSpeed(calibrationSpeed);
     }
-    void setEncoderOffset(double offset) {
-        double offsetDiff = offset - encoderOffset;
-        encoderOffset = offset;
-        limitA = mod(limitA + offsetDiff, 360.);
-        limitB = mod(limitB + offsetDiff, 360.);
+    void setEncoderOffset(float offset) {
+        BinaryAngle newOffset = BinaryAngle::fromDegrees(offset);
+        BinaryAngle offsetDiff = newOffset - encoderOffset;
+        encoderOffset = newOffset;
+        estimator.reset();
+        limitA = limitA + offsetDiff;
+        limitB = limitB + offsetDiff;
+    }
+    void resetSlipStats() {
+        slipCount = 0;
+        slipLast = 0.f;
+        slipTotal = 0.f;
     }
 private:
-    double getCalibratedAngle() {
-        double rawAngle = encoder.getAngle();
-        double index = rawAngle*calibrationSteps/360.;
-        double current = calibrationOffsets[int(floor(index)) % calibrationSteps];
-        double next = calibrationOffsets[int(ceil(index)) % calibrationSteps];
-        double offset = lerp(current, next, mod(index, 1.));
-        return mod(rawAngle + offset + encoderOffset, 360.);
+    void resyncSlip() {
+        float slip = estimator.innovation;
+        stepper.shiftPosition(slip);
+        estimator.offset = estimator.offset - BinaryAngle::fromDegrees(slip);
+        slipCount++;
+        slipLast = slip;
+        slipTotal += abs(slip);
+        slipEvents.push({uint32_t(millis()), slip, slipCount});
+    }
+    void runMove() {
+        // in PID mode run() closes the loop, calibration still uses moves
+        if (mode == ControlMode::PID && !calibrationRunning) return;
+        if (updateError() && abs(error) > tolerance && enabled) {
+            if (rampPlanned) stepper.setRamp(ramp);
+            else stepper.clearRamp();
+            stepper.moveR(error);
+        }
+        else if (abs(error) <= tolerance) rampPlanned = false;
+    }
+    bool isSettled() {
+        if (abs(error) > tolerance) return false;
+        return mode != ControlMode::PID || commandedVelocity == 0.f;
+    }
+    // Velocity from the position error. The integral is frozen while the
+    // output saturates and cleared while the target is held at a limit, so
+    // it cannot wind up against an end stop.
+    float getPidVelocity() {
+        uint32_t now = millis();
+        float dt = (now - lastPidUpdate) * 0.001f;
+        lastPidUpdate = now;
+        if (isnan(previousError) || dt > 1.f) {
+            previousError = error;
+            dt = 0.f;
+        }
+        float derivative = dt > 0.f ? (error - previousError) / dt : 0.f;
+        previousError = error;
+        float maxVelocity = stepper.getMaxVelocity();
+        float velocity = kp * error + integral + kd * derivative;
+        if (targetClamped) integral = 0.f;
+        else if (abs(velocity) < maxVelocity || error * integral < 0.f) {
+            integral = constrain(integral + ki * error * dt, -maxVelocity, maxVelocity);
+        }
+        return constrain(velocity, -maxVelocity, maxVelocity);
+    }
+    void runPid() {
+        if (!updateError()) return;
+        float velocity = abs(error) > tolerance ? getPidVelocity() : 0.f;
+        if (velocity == 0.f) previousError = NAN;
+        setVelocity(velocity);
+    }
+    void setVelocity(float velocity) {
+        if (isnan(commandedVelocity) || abs(velocity - commandedVelocity) > velocityDeadband || (velocity == 0.f && commandedVelocity != 0.f)) {
+            stepper.setVelocity(velocity);
+            commandedVelocity = velocity;
+        }
+    }
+    BinaryAngle getCalibratedPosition() {
+        BinaryAngle rawAngle = encoder.getPosition();
+        return rawAngle + BinaryAngle::fromDegrees(getCalibrationOffset(rawAngle)) + encoderOffset;
     }
     void runCalibration() {
-        double rawAngle = encoder.getAngle();
+        BinaryAngle rawPosition = encoder.getPosition();
         if (encoder.hasNewData()) {
-            double stepperAngle = stepper.getAngle();
-            double offset = mod(stepperAngle - rawAngle - calibrationStepperStartOffset + 180., 360.) - 180.;
+            float rawAngle = rawPosition.toDegrees();
+            float stepperAngle = stepper.getAngle();
+            float offset = angularDistance(stepperAngle - calibrationStepperStartOffset, rawAngle);
             ESP_LOGI("Calibration", "Offset %f, Encoder %f, Stepper %f", offset, rawAngle, stepperAngle);
-            float index = rawAngle*calibrationSteps/360.;
-            int current = int(floor(index)) % calibrationSteps;
-            if (calibrationOffsets[current] == 0.) {
-                calibrationOffsets[current] = offset;
+            uint32_t current = rawPosition.index(calibrationBits);
+            if (!calibrationFilled[current]) {
+                calibrationOffsets[current] = toFixedOffset(offset);
+                calibrationFilled[current] = true;
                 ESP_LOGI("Calibration", "current %d", current);
             }
             else {
-                int next = int(ceil(index)) % calibrationSteps;
-                double fract = mod(index, 1.);
-                calibrationOffsets[current] = lerp(calibrationOffsets[current], offset, calibrationDecay - fract * calibrationDecay);
-                if (calibrationOffsets[next] != 0.) calibrationOffsets[next] = lerp(calibrationOffsets[next], offset, fract * calibrationDecay);
+                uint32_t next = (current + 1) & (calibrationSteps - 1);
+                float fract = rawPosition.fraction(calibrationBits);
+                float currentOffset = calibrationOffsets[current] * calibrationScale;
+                calibrationOffsets[current] = toFixedOffset(lerp(currentOffset, offset, calibrationDecay - fract * calibrationDecay));
+                if (calibrationFilled[next]) {
+                    float nextOffset = calibrationOffsets[next] * calibrationScale;
+                    calibrationOffsets[next] = toFixedOffset(lerp(nextOffset, offset, fract * calibrationDecay));
+                }
             }
+            fitFourier(rawPosition, offset);
         }
         if (hasLimits) {
             if (abs(error) < tolerance) {
-                if (abs(angularDistance(getAngle(), limitA)) > abs(angularDistance(getAngle(), limitB))) {
+                BinaryAngle position = getPosition();
+                if (abs(position.distanceDegrees(limitA)) > abs(position.distanceDegrees(limitB))) {
                     setAngle(limitA);
                     ESP_LOGI("Calibration", "Goto A");
                 }
@@ -140,6 +386,41 @@ private:
             else setAngle(targetAngle);
         }
     }
+    // One LMS step of the Fourier coefficients towards the measured offset
+    void fitFourier(BinaryAngle rawAngle, float offset) {
+        float residual = offset - getFourierOffset(rawAngle);
+        float theta = degToRad(rawAngle.toDegrees());
+        float rate = fourierRate / (calibrationHarmonics + 1);
+        calibrationFourier[0] += rate * residual;
+        for (int k = 1; k <= calibrationHarmonics; k++) {
+            calibrationFourier[2 * k - 1] += 2.f * rate * residual * cosf(k * theta);
+            calibrationFourier[2 * k] += 2.f * rate * residual * sinf(k * theta);
+        }
+    }
+    void runTracking() {
+        float elapsed = (millis() - trajectoryStart) * 0.001f;
+        targetAngle = trajectoryAngle + BinaryAngle::fromDegrees(trajectoryVelocity * elapsed);
+        if (!updateError()) return;
+        if (abs(error) > trackingWindow) {
+            stepper.clearRamp();
+            stepper.moveR(error);
+            commandedVelocity = NAN;
+            return;
+        }
+        // no feed-forward when the target is clamped against a limit
+        float velocity = targetClamped ? 0.f : trajectoryVelocity;
+        velocity += mode == ControlMode::PID ? getPidVelocity() : trackingGain * error;
+        setVelocity(velocity);
+    }
+    BinaryAngle trajectoryAngle;
+    float trajectoryVelocity = 0.f;
+    float commandedVelocity = NAN;
+    bool targetClamped = false;
+    uint32_t trajectoryStart = 0;
     uint32_t lastPoll = 0;
+    float previousError = NAN;
+    SCurveProfile ramp;
+    bool rampPlanned = false;
+    uint32_t lastPidUpdate = 0;
 };
 #endif
\ No newline at end of file
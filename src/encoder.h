@@ -3,61 +3,214 @@
 
 #include <Arduino.h>
 #include <Wire.h>
+#include <angle.h>
+#include <samplering.h>
+#include <algorithm>
 
+struct EncoderSample
+{
+    uint32_t time;      // micros() when the read completed
+    int32_t raw;        // -1 when the read failed
+};
+
+// Read quality counters, the bus latency is kept as a histogram of
+// latencyBucket µs bins, the last one collecting everything above
+struct EncoderQuality
+{
+    static const int latencyBuckets = 64;
+    static const uint32_t latencyBucket = 50;
+    uint32_t samples = 0;
+    uint32_t dropouts = 0;
+    uint32_t outliers = 0;
+    uint32_t latency[latencyBuckets] = {};
+
+    void recordLatency(uint32_t micros) {
+        latency[min(micros / latencyBucket, uint32_t(latencyBuckets - 1))]++;
+    }
+    // Upper bound of the bin holding the given fraction of the reads
+    uint32_t getLatencyPercentile(float fraction) {
+        uint32_t total = 0;
+        for (int i = 0; i < latencyBuckets; i++) total += latency[i];
+        uint32_t count = 0;
+        for (int i = 0; i < latencyBuckets; i++) {
+            count += latency[i];
+            if (count > 0 && count >= fraction * total) return (i + 1) * latencyBucket;
+        }
+        return 0;
+    }
+    void reset() {
+        samples = 0;
+        dropouts = 0;
+        outliers = 0;
+        for (int i = 0; i < latencyBuckets; i++) latency[i] = 0;
+    }
+};
+
+// Absolute angle sensor. Backends only implement readEncoder(), returning
+// counts in [0, countsPerTurn) or -1; sampling, filtering and quality
+// counters are shared. See I2CEncoder below, as5047encoder.h and
+// pcntencoder.h.
 class Encoder
 {
 public:
-    double angle;
+    float angle;
+    BinaryAngle position;
     bool invert = false;
     bool error = false;
-    Encoder(int SDA = SDA, int SCL = SCL, TwoWire &I2C_ = Wire) : I2C(I2C_) {
-        I2C.begin(SDA, SCL);
-        // I2C.setClock(50000);
+    // median over the valid samples of the last filterWindow ms, at most
+    // maxFilterSize, then a gate on the rate of change against the last
+    // accepted position, with 1° of slack. maxOutliers rejections in a row
+    // are accepted as a real jump.
+    static const int maxFilterSize = 9;
+    int filterSize = 5;
+    uint32_t filterWindow = 25;
+    float maxRate = 180.f;
+    int maxOutliers = 3;
+    EncoderQuality quality;
+    const uint32_t countsPerTurn;
+    Encoder(uint32_t countsPerTurn) : countsPerTurn(countsPerTurn) {
+        bits = (countsPerTurn & (countsPerTurn - 1)) == 0 ? 31 - __builtin_clz(countsPerTurn) : 0;
     }
-    double getAngle() {
+    virtual ~Encoder() {}
+    // Peripheral setup that cannot run from a global constructor
+    virtual void begin() {}
+    virtual int readEncoder() = 0;
+    float getAngle() {
         update();
         return angle;
     }
+    BinaryAngle getPosition() {
+        update();
+        return position;
+    }
     bool hasNewData() {
         return newData && millis() - lastPoll <= maxPollInterval;
     }
+    // Samples the encoder from a task of its own at samplePeriod ms, update()
+    // then only reads the newest sample. One task per encoder, so encoders on
+    // different buses are read in parallel.
+    void startSampling(uint32_t period = 5, int core = CONFIG_ARDUINO_RUNNING_CORE) {
+        if (samplerTask != nullptr) return;
+        samplePeriod = period;
+        xTaskCreatePinnedToCore(
+            this->_samplerImpl,         // Function that should be called
+            "Encoder Sampler",          // Name of the task (for debugging)
+            2048,                       // Stack size (bytes)
+            this,                       // Pass reference to this class instance
+            (configMAX_PRIORITIES - 3), // just below the control task
+            &samplerTask,               // Task handle
+            core                        // Pin to core
+        );
+    }
     bool update() {
-        uint32_t now = millis();
-        if (now - lastPoll >= maxPollInterval) {
-            int value = readEncoder();
-            lastPoll = now;
-            if (value > 0) {
-                angle = value*360./16384.;
-                if (invert) angle = 360. - angle;
-                newData = true;
-                error = false;
-                return true;
-            }
-            else {
-                Serial.printf("Bad I2C Data : %d, Delay : %d\n", value, millis()-now);
-                newData = false;
-                error = true;
+        if (samplerTask == nullptr) {
+            uint32_t now = millis();
+            if (now - lastPoll >= maxPollInterval) {
+                lastPoll = now;
+                readSample();
             }
         }
-        return newData;
+        return updateFromSamples();
+    }
+    SampleRing<EncoderSample, 16> samples;
+protected:
+    uint32_t maxPollInterval = 20;
+private:
+    BinaryAngle toPosition(int32_t raw) {
+        return bits > 0 ? BinaryAngle::fromRaw(raw, bits) : BinaryAngle::fromCounts(raw, countsPerTurn);
     }
-    int readEncoder() {
-        int available = I2C.requestFrom(0x06, 3);
-        if (available > 2) {
+    void readSample() {
+        uint32_t start = micros();
+        int value = readEncoder();
+        uint32_t end = micros();
+        quality.recordLatency(end - start);
+        quality.samples++;
+        if (value < 0) quality.dropouts++;
+        samples.push({end, int32_t(value)});
+    }
+    bool updateFromSamples() {
+        uint32_t head = samples.size();
+        if (head == processedHead) return newData;
+        processedHead = head;
+        EncoderSample recent[maxFilterSize];
+        int count = samples.recent(recent, min(filterSize, int(maxFilterSize)));
+        if (count == 0) return false;
+        uint32_t now = micros();
+        lastPoll = millis() - (now - recent[0].time) / 1000;
+        // circular median : distances to the newest valid reading, sorted
+        int32_t distances[maxFilterSize];
+        int valid = 0;
+        BinaryAngle reference;
+        for (int i = 0; i < count && now - recent[i].time <= filterWindow * 1000; i++) {
+            if (recent[i].raw < 0) continue;
+            BinaryAngle reading = toPosition(recent[i].raw);
+            if (valid == 0) reference = reading;
+            distances[valid++] = reading.distance(reference);
+        }
+        if (valid == 0 || recent[0].raw < 0) {
+            newData = false;
+            error = true;
+            return false;
+        }
+        std::sort(distances, distances + valid);
+        BinaryAngle filtered = reference + distances[valid / 2];
+        if (invert) filtered = -filtered;
+        float dt = (recent[0].time - acceptedTime) * 1e-6f;
+        if (outlierRun < maxOutliers && acceptedTime != 0 && abs(filtered.distanceDegrees(position)) > maxRate * dt + 1.f) {
+            quality.outliers++;
+            outlierRun++;
+            newData = false;
+            return false;
+        }
+        outlierRun = 0;
+        acceptedTime = recent[0].time;
+        position = filtered;
+        angle = position.toDegrees();
+        newData = true;
+        error = false;
+        return true;
+    }
+    static void _samplerImpl(void *_this) { static_cast<Encoder *>(_this)->_sampler(); }
+    void _sampler() {
+        TickType_t xLastWakeTime = xTaskGetTickCount();
+        while (1) {
+            readSample();
+            vTaskDelayUntil(&xLastWakeTime, max(pdMS_TO_TICKS(samplePeriod), TickType_t(1)));
+        }
+    }
+    uint32_t processedHead = 0;
+    uint32_t acceptedTime = 0;
+    int outlierRun = 0;
+    TaskHandle_t samplerTask = nullptr;
+    uint32_t samplePeriod = 5;
+    int bits;
+    uint32_t lastPoll = 0;
+    bool newData = false;
+};
+
+// 14 bit magnetic encoder at I2C address 0x06
+class I2CEncoder : public Encoder
+{
+public:
+    I2CEncoder(int sda = SDA, int scl = SCL, TwoWire &I2C_ = Wire) : Encoder(1 << 14), I2C(I2C_) {
+        I2C.begin(sda, scl);
+        // I2C.setClock(50000);
+    }
+    // Register pointer write and read in one transaction, with a repeated start
+    int readEncoder() override {
+        I2C.beginTransmission(0x06);
+        I2C.write(0x02);  // set register for read
+        if (I2C.endTransmission(false) != 0) return -1;
+        if (I2C.requestFrom(0x06, 3) > 2) {
             byte buff[3];
-            I2C.beginTransmission(0x06);  
-            I2C.write(0x02);  // set register for read
-            I2C.endTransmission();
             I2C.readBytes(buff, 3);
             int value = (256 * buff[1] + buff[2])/4;
-            return value;
+            // the sensor never reports 0 on a good read
+            return value > 0 ? value : -1;
         }
         else return -1;
     }
 private:
     TwoWire &I2C;
-    uint32_t maxPollInterval = 20;
-    uint32_t lastPoll = 0;
-    bool newData = false;
 };
 #endif
\ No newline at end of file
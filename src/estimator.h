@@ -0,0 +1,67 @@
+#ifndef ESTIMATOR_H
+#define ESTIMATOR_H
+
+#include <Arduino.h>
+#include <angle.h>
+
+// Axis position from the stepper count, corrected by the absolute encoder.
+// The stepper gives position and rate at any time without bus traffic, the
+// Kalman filter tracks its offset to the encoder frame as a random walk.
+// A jump of the offset beyond slipThreshold means lost steps : the offset is
+// reset to the measurement and slipping is set until the next sample. The
+// load angle lags the rotor by up to a full step without losing any, the
+// default threshold is two full steps of a 200 step motor. The encoder
+// sample is older than the stepper count it is compared with, so the
+// threshold widens by slipLag seconds of travel at the current velocity
+// (about 2.2° at the 72°/s default slew).
+class AxisEstimator
+{
+public:
+    // offset drift in °²/s and encoder noise in °²
+    float processNoise = 1e-4f;
+    float measurementNoise = 1e-3f;
+    float slipThreshold = 3.6f;
+    float slipLag = 0.04f;
+
+    BinaryAngle offset;
+    float variance = 0.f;
+    float innovation = 0.f;
+    bool slipping = false;
+    bool valid = false;
+
+    void predict(uint32_t now) {
+        variance += processNoise * (now - lastUpdate) * 0.001f;
+        lastUpdate = now;
+    }
+
+    // velocity of the stepper in °/s
+    void correct(BinaryAngle stepperPosition, BinaryAngle measured, uint32_t now, float velocity = 0.f) {
+        predict(now);
+        innovation = measured.distanceDegrees(stepperPosition + offset);
+        slipping = valid && abs(innovation) > slipThreshold + slipLag * abs(velocity);
+        if (!valid || slipping) {
+            offset = measured - stepperPosition;
+            variance = measurementNoise;
+            valid = true;
+            return;
+        }
+        float gain = variance / (variance + measurementNoise);
+        offset = offset + BinaryAngle::fromDegrees(gain * innovation);
+        variance *= 1.f - gain;
+    }
+
+    BinaryAngle getPosition(BinaryAngle stepperPosition) {
+        return stepperPosition + offset;
+    }
+
+    void reset() {
+        valid = false;
+        slipping = false;
+        innovation = 0.f;
+    }
+
+private:
+    uint32_t lastUpdate = 0;
+};
+
+#endif
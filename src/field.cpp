@@ -0,0 +1,185 @@
+#include <field.h>
+#include <float.h>
+
+void HeliostatField::resize(size_t n) {
+    for (auto array : {&x, &y, &z, &targetX, &targetY, &targetZ, &normalX, &normalY, &normalZ, &azimuth, &elevation, &shading, &blocking}) {
+        array->resize(n);
+    }
+}
+
+void HeliostatField::add(vec3f position, vec3f target) {
+    size_t i = size();
+    resize(i + 1);
+    x[i] = position.x;
+    y[i] = position.y;
+    z[i] = position.z;
+    targetX[i] = target.x;
+    targetY[i] = target.y;
+    targetZ[i] = target.z;
+}
+
+void HeliostatField::reflect(SphericalCoordinate sun) {
+    reflect(toCartesian(vec2f{float(sun.azimuth), float(sun.elevation)}));
+}
+
+void HeliostatField::reflect(vec3f sun) {
+    sun = sun.normalize();
+    const size_t n = size();
+    const float *__restrict px = x.data(), *__restrict py = y.data(), *__restrict pz = z.data();
+    const float *__restrict tx = targetX.data(), *__restrict ty = targetY.data(), *__restrict tz = targetZ.data();
+    float *__restrict nx = normalX.data(), *__restrict ny = normalY.data(), *__restrict nz = normalZ.data();
+    // Normals : bisector of the sun direction and the direction to the target.
+    // Branch-free and free of calls besides sqrtf, so it vectorizes. The
+    // lengths are floored so degenerate mirrors stay finite : a mirror at its
+    // target faces the sun, one with the sun right behind its target gets a
+    // zero normal.
+    for (size_t i = 0; i < n; i++) {
+        float dx = tx[i] - px[i];
+        float dy = ty[i] - py[i];
+        float dz = tz[i] - pz[i];
+        float inv = 1.f / sqrtf(max(dx*dx + dy*dy + dz*dz, FLT_MIN));
+        float bx = sun.x + dx * inv;
+        float by = sun.y + dy * inv;
+        float bz = sun.z + dz * inv;
+        float norm = 1.f / sqrtf(max(bx*bx + by*by + bz*bz, FLT_MIN));
+        nx[i] = bx * norm;
+        ny[i] = by * norm;
+        nz[i] = bz * norm;
+    }
+    // Axis angles in a second pass, atan2f keeps the first one vectorizable
+    float *__restrict az = azimuth.data(), *__restrict el = elevation.data();
+    for (size_t i = 0; i < n; i++) {
+        az[i] = radToDeg(atan2f(ny[i], nx[i]));
+        el[i] = radToDeg(atan2f(sqrtf(nx[i]*nx[i] + ny[i]*ny[i]), nz[i]));
+    }
+}
+
+void HeliostatField::buildGrid() {
+    const size_t n = size();
+    float radius = 0.5f * sqrtf(mirrorWidth * mirrorWidth + mirrorHeight * mirrorHeight);
+    float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+    gridTop = -INFINITY;
+    for (size_t i = 0; i < n; i++) {
+        minX = min(minX, x[i]);
+        minY = min(minY, y[i]);
+        maxX = max(maxX, x[i]);
+        maxY = max(maxY, y[i]);
+        gridTop = max(gridTop, z[i] + radius);
+    }
+    grid.cellSize = 2.f * radius;
+    grid.originX = minX - radius;
+    grid.originY = minY - radius;
+    grid.sizeX = n > 0 ? int((maxX + radius - grid.originX) / grid.cellSize) + 1 : 0;
+    grid.sizeY = n > 0 ? int((maxY + radius - grid.originY) / grid.cellSize) + 1 : 0;
+    grid.cellStart.assign(grid.sizeX * grid.sizeY + 1, 0);
+    // two passes : count the entries per cell, then fill them in
+    for (int pass = 0; pass < 2; pass++) {
+        std::vector<uint32_t> fill(grid.cellStart.begin(), grid.cellStart.end() - 1);
+        for (size_t i = 0; i < n; i++) {
+            int x0 = int((x[i] - radius - grid.originX) / grid.cellSize);
+            int x1 = int((x[i] + radius - grid.originX) / grid.cellSize);
+            int y0 = int((y[i] - radius - grid.originY) / grid.cellSize);
+            int y1 = int((y[i] + radius - grid.originY) / grid.cellSize);
+            for (int cy = y0; cy <= y1; cy++) {
+                for (int cx = x0; cx <= x1; cx++) {
+                    int cell = cy * grid.sizeX + cx;
+                    if (pass == 0) grid.cellStart[cell + 1]++;
+                    else grid.items[fill[cell]++] = i;
+                }
+            }
+        }
+        if (pass == 0) {
+            for (size_t c = 1; c < grid.cellStart.size(); c++) grid.cellStart[c] += grid.cellStart[c - 1];
+            grid.items.resize(grid.cellStart.back());
+        }
+    }
+    rayStamp.assign(n, 0);
+    rayCount = 0;
+}
+
+void HeliostatField::getMirrorAxes(size_t i, vec3f &u, vec3f &v) {
+    // width along the horizontal, height in the plane of the normal and z
+    vec3f normal = {normalX[i], normalY[i], normalZ[i]};
+    float horizontal = sqrtf(normal.x * normal.x + normal.y * normal.y);
+    u = horizontal > 1e-6f ? vec3f{-normal.y / horizontal, normal.x / horizontal, 0.f} : vec3f{1.f, 0.f, 0.f};
+    v = normal.cross(u);
+}
+
+bool HeliostatField::intersects(size_t i, vec3f origin, vec3f direction, float range) {
+    vec3f normal = {normalX[i], normalY[i], normalZ[i]};
+    float denom = direction.dot(normal);
+    if (abs(denom) < 1e-6f) return false;
+    vec3f center = {x[i], y[i], z[i]};
+    float t = (center - origin).dot(normal) / denom;
+    if (t <= 1e-4f || t > range) return false;
+    vec3f hit = origin + direction * t - center;
+    vec3f u, v;
+    getMirrorAxes(i, u, v);
+    return abs(hit.dot(u)) <= 0.5f * mirrorWidth && abs(hit.dot(v)) <= 0.5f * mirrorHeight;
+}
+
+bool HeliostatField::castRay(size_t self, vec3f origin, vec3f direction, float range) {
+    // 2D DDA over the grid cells under the ray, up to the top of the field
+    // or the end of the range
+    float tMax = direction.z > 1e-6f ? min((gridTop - origin.z) / direction.z, range) : range;
+    int cx = int((origin.x - grid.originX) / grid.cellSize);
+    int cy = int((origin.y - grid.originY) / grid.cellSize);
+    int stepX = direction.x > 0.f ? 1 : -1;
+    int stepY = direction.y > 0.f ? 1 : -1;
+    float deltaX = direction.x != 0.f ? grid.cellSize / abs(direction.x) : INFINITY;
+    float deltaY = direction.y != 0.f ? grid.cellSize / abs(direction.y) : INFINITY;
+    float nextX = direction.x != 0.f ? ((cx + (stepX > 0)) * grid.cellSize + grid.originX - origin.x) / direction.x : INFINITY;
+    float nextY = direction.y != 0.f ? ((cy + (stepY > 0)) * grid.cellSize + grid.originY - origin.y) / direction.y : INFINITY;
+    rayCount++;
+    float t = 0.f;
+    while (t <= tMax && cx >= 0 && cx < grid.sizeX && cy >= 0 && cy < grid.sizeY) {
+        int cell = cy * grid.sizeX + cx;
+        for (uint32_t k = grid.cellStart[cell]; k < grid.cellStart[cell + 1]; k++) {
+            uint32_t j = grid.items[k];
+            if (j == self || rayStamp[j] == rayCount) continue;
+            rayStamp[j] = rayCount;
+            if (intersects(j, origin, direction, range)) return true;
+        }
+        if (nextX < nextY) {
+            t = nextX;
+            nextX += deltaX;
+            cx += stepX;
+        }
+        else {
+            t = nextY;
+            nextY += deltaY;
+            cy += stepY;
+        }
+    }
+    return false;
+}
+
+void HeliostatField::computeShading(vec3f sun) {
+    sun = sun.normalize();
+    const size_t n = size();
+    const float samples = shadingSamples * shadingSamples;
+    for (size_t i = 0; i < n; i++) {
+        vec3f center = {x[i], y[i], z[i]};
+        vec3f target = {targetX[i], targetY[i], targetZ[i]};
+        vec3f u, v;
+        getMirrorAxes(i, u, v);
+        int shaded = 0;
+        int blocked = 0;
+        for (int a = 0; a < shadingSamples; a++) {
+            for (int b = 0; b < shadingSamples; b++) {
+                float du = mirrorWidth * ((a + 0.5f) / shadingSamples - 0.5f);
+                float dv = mirrorHeight * ((b + 0.5f) / shadingSamples - 0.5f);
+                vec3f point = center + u * du + v * dv;
+                if (castRay(i, point, sun)) shaded++;
+                // only mirrors between the sample and the target block it
+                else {
+                    vec3f toTarget = target - point;
+                    float distance = toTarget.length();
+                    if (castRay(i, point, toTarget / distance, distance)) blocked++;
+                }
+            }
+        }
+        shading[i] = shaded / samples;
+        blocking[i] = blocked / samples;
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef HELIOSTAT_FIELD_H
+#define HELIOSTAT_FIELD_H
+
+#include <vector>
+#include <geometry.h>
+
+// Uniform grid over the field footprint. Each mirror is registered in every
+// cell its bounding circle overlaps, cells are stored as offsets into a
+// single item array.
+struct FieldGrid
+{
+    float originX = 0.f;
+    float originY = 0.f;
+    float cellSize = 1.f;
+    int sizeX = 0;
+    int sizeY = 0;
+    std::vector<uint32_t> cellStart;
+    std::vector<uint32_t> items;
+};
+
+// Heliostat field stored as structure of arrays, so that the mirror normals
+// of the whole field can be computed in one vectorizable pass for a shared
+// sun direction. Angles follow HeliostatController::reflect() : azimuth is
+// measured from x towards y, elevation is the angle from the z axis.
+struct HeliostatField
+{
+    std::vector<float> x, y, z;
+    std::vector<float> targetX, targetY, targetZ;
+    std::vector<float> normalX, normalY, normalZ;
+    std::vector<float> azimuth, elevation;
+    std::vector<float> shading, blocking;
+    float mirrorWidth = 2.f;
+    float mirrorHeight = 2.f;
+    int shadingSamples = 4;
+
+    size_t size() {return x.size();}
+    void resize(size_t n);
+    void add(vec3f position, vec3f target);
+    void reflect(SphericalCoordinate sun);
+    void reflect(vec3f sun);
+    SphericalCoordinate getAngles(size_t i) {return {azimuth[i], elevation[i]};}
+
+    // Shading and blocking fractions per mirror, sampled with
+    // shadingSamples x shadingSamples rays towards the sun and towards the
+    // target. sun must be the direction passed to reflect(vec3f) with z up.
+    // buildGrid() has to be called again when mirrors are added or moved.
+    void buildGrid();
+    void computeShading(vec3f sun);
+
+private:
+    // hits beyond range along the ray are ignored
+    bool castRay(size_t self, vec3f origin, vec3f direction, float range = INFINITY);
+    bool intersects(size_t i, vec3f origin, vec3f direction, float range = INFINITY);
+    void getMirrorAxes(size_t i, vec3f &u, vec3f &v);
+    FieldGrid grid;
+    float gridTop = 0.f;
+    std::vector<uint32_t> rayStamp;
+    uint32_t rayCount = 0;
+};
+
+#endif
@@ -1,22 +1,24 @@
 #include <geometry.h>
-vec2 vec3::toSpherical() {
-    double theta = atan2(sqrt(x*x + y*y), z);
-    double phi = atan2(y, x);
-    return vec2{theta, phi};
-}
 
-vec3 toCartesian(vec2 spherical) {
+template<typename T>
+vec3T<T> toCartesian(vec2T<T> spherical) {
     spherical = degToRad(spherical);
-    return vec3{
-        sin(spherical.y) * cos(spherical.x),
-        sin(spherical.y) * sin(spherical.x),
-        cos(spherical.y)
+    return vec3T<T>{
+        std::sin(spherical.y) * std::cos(spherical.x),
+        std::sin(spherical.y) * std::sin(spherical.x),
+        std::cos(spherical.y)
     };
 }
 
-vec2 toSpherical(vec3 cartesian) {
-    double r = std::sqrt(cartesian.x * cartesian.x + cartesian.y * cartesian.y + cartesian.z * cartesian.z);       // Radius
-    double theta = std::atan2(cartesian.y, cartesian.x);
-    double phi = std::acos(cartesian.z / r);
-    return radToDeg(vec2{theta, phi});
-}
\ No newline at end of file
+template<typename T>
+vec2T<T> toSpherical(vec3T<T> cartesian) {
+    T rxy = std::sqrt(cartesian.x * cartesian.x + cartesian.y * cartesian.y);
+    T theta = std::atan2(cartesian.y, cartesian.x);
+    T phi = std::atan2(rxy, cartesian.z);                                   // acos(z/r), without the loss of precision near the poles
+    return radToDeg(vec2T<T>{theta, phi});
+}
+
+template vec3T<double> toCartesian(vec2T<double> spherical);
+template vec3T<float> toCartesian(vec2T<float> spherical);
+template vec2T<double> toSpherical(vec3T<double> cartesian);
+template vec2T<float> toSpherical(vec3T<float> cartesian);
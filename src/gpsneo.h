@@ -6,6 +6,8 @@
 
 #include <TinyGPS++.h>
 #include "TimeLib.h"
+#include <atomic>
+#include <samplering.h>
 
 struct GeoCoords {
     double longitude;
@@ -13,12 +15,82 @@ struct GeoCoords {
     double altitude;
 };
 
+// bytes, 9600 baud fills about 1 KB per second
+#ifndef GPS_RX_BUFFER_SIZE
+#define GPS_RX_BUFFER_SIZE 1024
+#endif
+
+// State of the receiver as parsed by the UART event task
+struct GPSFix {
+    GeoCoords coords;
+    int fixQuality = 0;
+    int numSats = 0;
+    bool timeValid = false;
+    uint8_t hour, minute, second, day, month;
+    uint16_t year;
+    // incremented on each location sentence
+    uint32_t locationUpdates = 0;
+    uint32_t passedChecksums = 0;
+    uint32_t failedChecksums = 0;
+};
+
+// NMEA sentences are parsed from the HardwareSerial event task, woken by the
+// UART driver when the FIFO fills or the line goes idle, so no byte waits for
+// loop(). Fixes are published through a ring the readers copy from without
+// locking.
 class SerialGPS {
 private:
     const uint8_t TX;
     const uint8_t RX;
     HardwareSerial &serial;
     TinyGPSPlus gps;
+    GPSFix parsed;
+    SampleRing<GPSFix, 4> fixes;
+    uint32_t lastFixCount = 0;
+    uint32_t lastLocationUpdates = 0;
+    std::atomic<uint32_t> lastReceive{0};
+    std::atomic<bool> receiving{false};
+
+    void receive() {
+        while (serial.available() > 0) {
+            gps.encode(serial.read());
+            bytesReceived++;
+        }
+        lastReceive = millis();
+        receiving = true;
+        bool updated = false;
+        if (gps.satellites.isUpdated()) {
+            parsed.numSats = gps.satellites.value();
+            updated = true;
+        }
+        if (gps.time.isUpdated() && gps.time.isValid()) {
+            parsed.timeValid = true;
+            parsed.hour = gps.time.hour();
+            parsed.minute = gps.time.minute();
+            parsed.second = gps.time.second();
+            parsed.day = gps.date.day();
+            parsed.month = gps.date.month();
+            parsed.year = gps.date.year();
+            updated = true;
+        }
+        if (gps.location.isUpdated()) {
+            parsed.coords.latitude = gps.location.lat();
+            parsed.coords.longitude = gps.location.lng();
+            parsed.coords.altitude = gps.altitude.meters();
+            parsed.fixQuality = gps.location.FixQuality();
+            parsed.locationUpdates++;
+            updated = true;
+        }
+        if (gps.failedChecksum() != parsed.failedChecksums) updated = true;
+        parsed.passedChecksums = gps.passedChecksum();
+        parsed.failedChecksums = gps.failedChecksum();
+        if (updated) fixes.push(parsed);
+    }
+
+    void receiveError(hardwareSerialError_t error) {
+        if (error == UART_BUFFER_FULL_ERROR || error == UART_FIFO_OVF_ERROR) overruns++;
+        else errors++;
+    }
 
 public:
     GeoCoords coords;
@@ -29,43 +101,54 @@ public:
     char timeStr[16];
     char dateStr[16];
     bool hasSerial = false;
+    uint32_t passedChecksums = 0;
+    uint32_t failedChecksums = 0;
+    // counted by the UART event task
+    std::atomic<uint32_t> bytesReceived{0};
+    std::atomic<uint32_t> overruns{0};
+    std::atomic<uint32_t> errors{0};
 
     SerialGPS(HardwareSerial &serial_ = Serial1, uint8_t RX_ = 25, uint8_t TX_ = 33) : serial(serial_), RX(RX_), TX(TX_) {}
     void init() {
+        // the driver buffer is allocated by begin()
+        serial.setRxBufferSize(GPS_RX_BUFFER_SIZE);
         serial.begin(9600, SERIAL_8N1, RX, TX);
+        serial.onReceive([this]() {receive();});
+        serial.onReceiveError([this](hardwareSerialError_t error) {receiveError(error);});
     }
+    // Takes the latest fix, returns true when the location or the serial
+    // link state changed
     bool update() {
         unsigned long now = millis();
         bool updated = false;
-        if (serial.available() > 0) {
-            while (serial.available() > 0) {
-                int s = serial.read();
-                gps.encode(s);
-                // Serial.print(char(s));
-            }
-            if (gps.satellites.isUpdated()) {
-                numSats = gps.satellites.value();
+        GPSFix fix;
+        uint32_t count = fixes.size();
+        if (count != lastFixCount && fixes.latest(fix)) {
+            lastFixCount = count;
+            numSats = fix.numSats;
+            passedChecksums = fix.passedChecksums;
+            failedChecksums = fix.failedChecksums;
+            if (fix.timeValid) {
+                sprintf(timeStr, "%i:%i:%i", fix.hour, fix.minute, fix.second);
+                sprintf(dateStr, "%i/%i/%i", fix.day, fix.month, fix.year);
+                setTime(fix.hour, fix.minute, fix.second, fix.day, fix.month, fix.year);
             }
-            if (gps.time.isValid()) {
-                sprintf(timeStr, "%i:%i:%i", gps.time.hour(), gps.time.minute(), gps.time.second());
-                sprintf(dateStr, "%i/%i/%i", gps.date.day(), gps.date.month(), gps.date.year());
-                setTime(gps.time.hour(), gps.time.minute(), gps.time.second(), gps.date.day(), gps.date.month(), gps.date.year());
-                // updated = true;
-            }
-            if (gps.location.isUpdated()) {
-                coords.latitude = gps.location.lat();
-                coords.longitude = gps.location.lng();
-                coords.altitude = gps.altitude.meters();
-                fixQuality = gps.location.FixQuality();
+            if (fix.locationUpdates != lastLocationUpdates) {
+                lastLocationUpdates = fix.locationUpdates;
+                coords = fix.coords;
+                fixQuality = fix.fixQuality;
                 updated = true;
             }
+        }
+        uint32_t received = lastReceive;
+        if (receiving && now - received <= 10000) {
             if (!hasSerial) {
                 updated = true;
                 hasSerial = true;
             }
-            lastUpdate = now;
+            lastUpdate = received;
         }
-        else if (hasSerial && now - lastUpdate > 10000) {
+        else if (hasSerial) {
             hasSerial = false;
             updated = true;
         }
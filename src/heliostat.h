@@ -3,19 +3,80 @@
 
 #include <closedloopcontroller.h>
 #include <sun.h>
+#include <pointingmodel.h>
 #include <gpsneo.h>
+#include <map>
 
 using DirectionsMap = std::map<String, SphericalCoordinate>;
 
+// ms between control steps, one setting for the task that runs all mirrors
+#ifndef HELIOSTAT_CONTROL_PERIOD
+#define HELIOSTAT_CONTROL_PERIOD 10
+#endif
+
+// Wake-up timing of the fixed rate control task, jitter is measured against
+// the previous wake-up plus the period. The task drives every mirror, so
+// there is one shared instance, recorded by the task right after it wakes.
+struct ControlTiming
+{
+    uint32_t period = HELIOSTAT_CONTROL_PERIOD;
+    uint32_t ticks = 0;
+    uint32_t lastWake = 0;
+    uint32_t periodMinMicros = UINT32_MAX;
+    uint32_t periodMaxMicros = 0;
+    uint32_t jitterMaxMicros = 0;
+    uint64_t jitterMicros = 0;
+    uint64_t periodMicros = 0;
+
+    static ControlTiming &shared()
+    {
+        static ControlTiming timing;
+        return timing;
+    }
+
+    void record(uint32_t wake)
+    {
+        if (resetPending) {
+            ticks = 0;
+            periodMinMicros = UINT32_MAX;
+            periodMaxMicros = 0;
+            jitterMaxMicros = 0;
+            jitterMicros = 0;
+            periodMicros = 0;
+            resetPending = false;
+        }
+        if (ticks > 0) {
+            uint32_t elapsed = wake - lastWake;
+            uint32_t jitter = abs(int32_t(elapsed - period * 1000));
+            periodMinMicros = min(periodMinMicros, elapsed);
+            periodMaxMicros = max(periodMaxMicros, elapsed);
+            periodMicros += elapsed;
+            jitterMaxMicros = max(jitterMaxMicros, jitter);
+            jitterMicros += jitter;
+        }
+        lastWake = wake;
+        ticks++;
+    }
+
+    // The statistics are cleared by the control task on its next wake-up
+    void reset()
+    {
+        resetPending = true;
+    }
+
+private:
+    volatile bool resetPending = false;
+};
+
 class HeliostatController
 {
 public:
-    HeliostatController(ClosedLoopController &azimuthController, ClosedLoopController &elevationController, SerialGPS &gps) : 
-        azimuthController(azimuthController), elevationController(elevationController), gps(gps) {}
+    HeliostatController(ClosedLoopController &azimuthController, ClosedLoopController &elevationController, SerialGPS &gps, SolarEphemeris &ephemeris = SolarEphemeris::shared()) : 
+        ephemeris(ephemeris), azimuthController(azimuthController), elevationController(elevationController), gps(gps) {}
 
     SphericalCoordinate getTarget() 
     {
-        return SphericalCoordinate{azimuthController.targetAngle, elevationController.targetAngle};
+        return SphericalCoordinate{azimuthController.targetAngle.toDegrees(), elevationController.targetAngle.toDegrees()};
     }
 
     SphericalCoordinate getPosition() 
@@ -25,42 +86,122 @@ public:
 
     void setPosition(double azimuth, double elevation)
     {
-        azimuthController.setAngle(azimuth);
-        elevationController.setAngle(elevation);
+        setPosition(SphericalCoordinate{azimuth, elevation});
     }
 
+    // Both axes follow S-curve ramps stretched to arrive at the same time
     void setPosition(SphericalCoordinate target)
     {
-        azimuthController.setAngle(target.azimuth);
-        elevationController.setAngle(target.elevation);
+        BinaryAngle azimuth = BinaryAngle::fromDegrees(target.azimuth);
+        BinaryAngle elevation = BinaryAngle::fromDegrees(target.elevation);
+        SCurveProfile azimuthRamp = azimuthController.planMove(azimuth);
+        SCurveProfile elevationRamp = elevationController.planMove(elevation);
+        SCurveProfile::synchronize(azimuthRamp, elevationRamp);
+        moveDuration = azimuthRamp.duration;
+        azimuthController.setAngle(azimuth, azimuthRamp);
+        elevationController.setAngle(elevation, elevationRamp);
     }
 
     SphericalCoordinate reflect(SphericalCoordinate source, SphericalCoordinate target) 
     {
-        vec3 bisector = toCartesian({source.azimuth, source.elevation}) + toCartesian({target.azimuth, target.elevation});
-        vec2 result = toSpherical(bisector);
+        vec2f result = reflectDirection(vec2f{float(source.azimuth), float(source.elevation)}, vec2f{float(target.azimuth), float(target.elevation)}, mount);
         // ESP_LOGI("Reflector", "%f %f", result.x, result.y);
         return {result.x, result.y};
     }
 
-    void reflectCurrentSource() {
-        auto directionsMap = getDirectionsMap();
+    bool getReflection(double t, SphericalCoordinate &reflection, bool corrected = true) {
+        auto directionsMap = getDirectionsMap(t);
         if (directionsMap.find(currentSource) != directionsMap.end() && directionsMap.find(currentTarget) != directionsMap.end()) {
-            auto reflection = reflect(directionsMap[currentSource], directionsMap[currentTarget]);
-            setPosition(reflection);
+            reflection = reflect(directionsMap[currentSource], directionsMap[currentTarget]);
+            if (corrected) reflection = pointingModel.apply(reflection);
+            return true;
+        }
+        return false;
+    }
+
+    void reflectCurrentSource() {
+        double t = now();
+        SphericalCoordinate reflection, next, after;
+        if (getReflection(t, reflection)) {
+            getReflection(t + feedForwardHorizon, next);
+            float azimuthVelocity = azimuthController.angularDistance(next.azimuth, reflection.azimuth) / feedForwardHorizon;
+            float elevationVelocity = elevationController.angularDistance(next.elevation, reflection.elevation) / feedForwardHorizon;
+            float tolerance = min(azimuthController.tolerance, elevationController.tolerance);
+            float interval;
+            bool tracking = feedForward && (currentSource == "Sun" || currentTarget == "Sun");
+            if (tracking) {
+                azimuthController.setTrajectory(reflection.azimuth, azimuthVelocity);
+                elevationController.setTrajectory(reflection.elevation, elevationVelocity);
+                // the linear extrapolation drifts with the angular acceleration
+                getReflection(t + 2 * feedForwardHorizon, after);
+                float azimuthAccel = azimuthController.angularDistance(after.azimuth, next.azimuth) / feedForwardHorizon - azimuthVelocity;
+                float elevationAccel = elevationController.angularDistance(after.elevation, next.elevation) / feedForwardHorizon - elevationVelocity;
+                float accel = max(abs(azimuthAccel), abs(elevationAccel)) / feedForwardHorizon;
+                interval = sqrtf(tolerance / accel);
+            }
+            else {
+                setPosition(reflection);
+                interval = 0.5f * tolerance / max(abs(azimuthVelocity), abs(elevationVelocity));
+            }
+            // wake up when half the tolerance is used up
+            interval = isnan(interval) ? maxReaimInterval : min(interval * 1000.f, float(maxReaimInterval));
+            reaimInterval = max(uint32_t(interval), minReaimInterval);
+            // between re-aims a settled axis only checks for disturbances, at
+            // half the interval; the feed-forward trim keeps the regular polls
+            uint32_t pollInterval = tracking ? 0 : reaimInterval / 2;
+            azimuthController.scheduledPollInterval = pollInterval;
+            elevationController.scheduledPollInterval = pollInterval;
             // ESP_LOGI("Reflector", "%f %f", reflection.azimuth, reflection.elevation);
         }
     }
 
+    // Fit the pointing model with the current axis position, once the spot
+    // has been brought onto the target by hand
+    bool observePointingError() {
+        SphericalCoordinate reflection;
+        if (!getReflection(now(), reflection, false)) return false;
+        pointingModel.observe(reflection, getPosition());
+        scheduleReaim();
+        return true;
+    }
+
+    // Re-aim on the next run() instead of waiting for the scheduled one,
+    // used when the source or target changes.
+    void scheduleReaim() {
+        reaimInterval = 0;
+    }
+
     void run() 
     {
+        uint32_t start = micros();
         unsigned long now = millis();
-        if (enabled & now - lastCommand > 1000) {
+        if (enabled && now - lastCommand >= reaimInterval) {
+            if (reaimsExecuted > 0) reaimsSkipped += max(long(now - lastCommand) / 1000 - 1, 0L);
+            reaimsExecuted++;
             reflectCurrentSource();
             lastCommand = now;
         }
         azimuthController.run();
         elevationController.run();
+        uint32_t elapsed = micros() - start;
+        loopTicks++;
+        loopMicros += elapsed;
+        loopMaxMicros = max(loopMaxMicros, elapsed);
+    }
+
+    uint32_t getCommandCount() 
+    {
+        return azimuthController.stepper.commandCount + elevationController.stepper.commandCount;
+    }
+
+    void resetStats() 
+    {
+        loopTicks = 0;
+        loopMicros = 0;
+        loopMaxMicros = 0;
+        controlTiming.reset();
+        azimuthController.resetErrorStats();
+        elevationController.resetErrorStats();
     }
 
     void init() 
@@ -68,12 +209,12 @@ public:
         setupSolarTracker();
         azimuthController.getAngle();
         if (azimuthController.encoder.hasNewData()) {
-            azimuthController.targetAngle =  azimuthController.getAngle();
+            azimuthController.targetAngle = azimuthController.getPosition();
             azimuthController.run();
         }
         elevationController.getAngle();
         if (elevationController.encoder.hasNewData()) {
-            elevationController.targetAngle =  elevationController.getAngle();
+            elevationController.targetAngle = elevationController.getPosition();
             elevationController.run();
         }
     }
@@ -86,6 +227,12 @@ public:
     }
 
     bool enabled = true;
+    MountOrientation mount;
+    PointingModel pointingModel;
+    // Track the sun with continuous stepper velocity instead of periodic
+    // moves. Opt-in, saved with the heliostat settings.
+    bool feedForward = false;
+    float feedForwardHorizon = 60.f;
 
     String currentSource = "Sun";
     String currentTarget = "Default Target";
@@ -102,13 +249,20 @@ public:
 
     SphericalCoordinate getSolarPosition() 
     {
-        return computeSolarPosition(latitude, longitude);
+        return ephemeris.getPosition(latitude, longitude);
     }
 
+    SolarEphemeris &ephemeris;
+
     DirectionsMap getDirectionsMap() 
+    {
+        return getDirectionsMap(now());
+    }
+
+    DirectionsMap getDirectionsMap(double t) 
     {
         DirectionsMap map = {};
-        if (isTimeSet()) map.insert({"Sun", getSolarPosition()});
+        if (isTimeSet()) map.insert({"Sun", ephemeris.getPosition(latitude, longitude, t)});
         map.insert(targetsMap.begin(), targetsMap.end());
         return map;
     }
@@ -152,6 +306,20 @@ public:
     ClosedLoopController &elevationController;
 
     unsigned long lastCommand = 0;
+    // Re-aims are scheduled from the predicted drift of the reflected normal.
+    // reaimsSkipped counts the fixed 1 s slots that were not needed.
+    uint32_t minReaimInterval = 250;
+    uint32_t maxReaimInterval = 60000;
+    uint32_t reaimInterval = 0;
+    uint32_t reaimsExecuted = 0;
+    uint32_t reaimsSkipped = 0;
+    // planned duration of the last coordinated move, in s
+    float moveDuration = 0.f;
+    // CPU time spent in run(), to size how many axes a board can drive
+    uint32_t loopTicks = 0;
+    uint64_t loopMicros = 0;
+    uint32_t loopMaxMicros = 0;
+    ControlTiming &controlTiming = ControlTiming::shared();
     SerialGPS &gps;
 };
 #endif
\ No newline at end of file
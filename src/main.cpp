@@ -30,28 +30,126 @@ ESP32SvelteKit esp32sveltekit(&server, 120);
 
 FastAccelStepperEngine engine = FastAccelStepperEngine();
 
-TMC5160Stepper driver1(10, R_SENSE, 13, 11, 12);
-TMC5160Stepper driver2(7, R_SENSE, 13, 11, 12);
+#ifndef HELIOSTAT_COUNT
+#define HELIOSTAT_COUNT 1
+#endif
 
-TMC5160Controller stepper1 = {driver1, engine, 9, 8};
-TMC5160Controller stepper2 = {driver2, engine, 6, 5};
+// Driver wiring, azimuth then elevation for each heliostat. The drivers
+// share software SPI on DRIVER_SPI_PINS (MOSI, MISO, SCK), used from the
+// control task only. Axes the engine has no step generator left for run on
+// the driver ramp generator.
+#ifndef DRIVER_SPI_PINS
+#define DRIVER_SPI_PINS 13, 11, 12
+#endif
 
-Encoder encoder1 = Encoder(2, 1);
-Encoder encoder2 = Encoder(4, 3, Wire1);
+struct AxisPins
+{
+    int CS;
+    int STEP;
+    int DIR;
+};
 
-ClosedLoopController closedLoopController1 = {stepper1, encoder1};
-ClosedLoopController closedLoopController2 = {stepper2, encoder2};
+// CS, STEP, DIR rows, two mirrors by default. Other wirings and more
+// mirrors are set with -D AXIS_PINS="{10,9,8},{7,6,5},...".
+#ifndef AXIS_PINS
+#define AXIS_PINS {10, 9, 8}, {7, 6, 5}, {21, 38, 39}, {40, 41, 42}
+#endif
 
-SerialGPS gpsneo = SerialGPS(Serial1, TX, RX);
+const AxisPins axisPins[] = {AXIS_PINS};
 
-HeliostatController heliostatController = {closedLoopController1, closedLoopController2, gpsneo};
+// Encoder backend, I2C unless ENCODER_AS5047 or ENCODER_PCNT is defined
+#if defined(ENCODER_AS5047)
+#include <as5047encoder.h>
+// SCK, MISO, MOSI of a hardware SPI bus of their own. The sampler tasks
+// preempt the control task, so the encoders must not share the driver pins.
+// The encoders share this bus, each transfer holds the SPIClass lock.
+#ifndef ENCODER_SPI_PINS
+#define ENCODER_SPI_PINS 14, 15, 16
+#endif
+constexpr bool sharesPin(int a, int b, int c, int x, int y, int z) {
+    return a == x || a == y || a == z || b == x || b == y || b == z || c == x || c == y || c == z;
+}
+static_assert(!sharesPin(DRIVER_SPI_PINS, ENCODER_SPI_PINS), "the encoders need SPI pins of their own");
+SPIClass encoderSPI(HSPI);
+// CS rows, the ENCODER_PINS list overrides them
+#ifndef ENCODER_PINS
+#define ENCODER_PINS {2}, {4}, {47}, {48}
+#endif
+const int encoderPins[][1] = {ENCODER_PINS};
+Encoder *createEncoder(int axis) {return new AS5047Encoder(encoderPins[axis][0], ENCODER_SPI_PINS, encoderSPI);}
+#elif defined(ENCODER_PCNT)
+#include <pcntencoder.h>
+#ifndef ENCODER_PCNT_COUNTS
+#define ENCODER_PCNT_COUNTS 4096
+#endif
+// A, B rows, the ENCODER_PINS list overrides them. One counter unit each.
+// The default MCPWM/PCNT step generators count steps on PCNT units too, so
+// the steppers are put on RMT and the encoders get every unit.
+#ifndef ENCODER_PINS
+#define ENCODER_PINS {2, 1}, {4, 3}, {47, 48}, {14, 15}
+#endif
+const int encoderPins[][2] = {ENCODER_PINS};
+#define STEP_DRIVER DRIVER_RMT
+// RMT step generators use no PCNT unit, the ESP32-S3 has four RMT channels
+const int stepperPcntUnits = 0;
+static_assert(2 * HELIOSTAT_COUNT + stepperPcntUnits <= PCNT_UNIT_MAX, "the encoders and step generators need a PCNT unit each");
+Encoder *createEncoder(int axis) {return new PCNTEncoder(encoderPins[axis][0], encoderPins[axis][1], ENCODER_PCNT_COUNTS, pcnt_unit_t(axis));}
+#else
+// SDA, SCL, the encoders have a fixed address so one bus each
+#ifndef ENCODER_PINS
+#define ENCODER_PINS {2, 1}, {4, 3}
+#endif
+const int encoderPins[][2] = {ENCODER_PINS};
+static_assert(HELIOSTAT_COUNT == 1, "I2C encoders need a bus each, the two buses drive one mirror");
+TwoWire *encoderBuses[] = {&Wire, &Wire1};
+Encoder *createEncoder(int axis) {return new I2CEncoder(encoderPins[axis][0], encoderPins[axis][1], *encoderBuses[axis]);}
+#endif
 
-HeliostatService heliostatService = HeliostatService(
-    &server,
-    esp32sveltekit.getSocket(),
-    esp32sveltekit.getFS(),
-    esp32sveltekit.getSecurityManager(),
-    heliostatController);
+#ifndef STEP_DRIVER
+#define STEP_DRIVER DRIVER_DONT_CARE
+#endif
+
+static_assert(sizeof(axisPins) / sizeof(axisPins[0]) >= 2 * HELIOSTAT_COUNT, "two AXIS_PINS rows per heliostat");
+static_assert(sizeof(encoderPins) / sizeof(encoderPins[0]) >= 2 * HELIOSTAT_COUNT, "two ENCODER_PINS rows per heliostat");
+
+#ifndef ENCODER_SAMPLE_PERIOD
+#if defined(ENCODER_AS5047) || defined(ENCODER_PCNT)
+#define ENCODER_SAMPLE_PERIOD 1
+#else
+#define ENCODER_SAMPLE_PERIOD 5
+#endif
+#endif
+
+std::vector<TMC5160Controller *> steppers;
+std::vector<Encoder *> encoders;
+std::vector<ClosedLoopController *> closedLoopControllers;
+std::vector<HeliostatController *> heliostatControllers;
+std::vector<HeliostatService *> heliostatServices;
+
+SerialGPS gpsneo = SerialGPS(Serial1, TX, RX);
+
+// The mirrors share the engine, the GPS and the solar ephemeris. The first
+// one keeps the "heliostat" paths and config file, the next are numbered.
+void createHeliostats()
+{
+    for (int i = 0; i < 2 * HELIOSTAT_COUNT; i++) {
+        TMC5160Stepper *driver = new TMC5160Stepper(axisPins[i].CS, R_SENSE, DRIVER_SPI_PINS);
+        steppers.push_back(new TMC5160Controller(*driver, engine, axisPins[i].STEP, axisPins[i].DIR));
+        steppers[i]->stepDriver = STEP_DRIVER;
+        encoders.push_back(createEncoder(i));
+        closedLoopControllers.push_back(new ClosedLoopController(*steppers[i], *encoders[i]));
+    }
+    for (int i = 0; i < HELIOSTAT_COUNT; i++) {
+        heliostatControllers.push_back(new HeliostatController(*closedLoopControllers[2 * i], *closedLoopControllers[2 * i + 1], gpsneo));
+        heliostatServices.push_back(new HeliostatService(
+            &server,
+            esp32sveltekit.getSocket(),
+            esp32sveltekit.getFS(),
+            esp32sveltekit.getSecurityManager(),
+            *heliostatControllers[i],
+            i == 0 ? String("heliostat") : "heliostat" + String(i + 1)));
+    }
+}
 
 GPSSettingsService gpsSettingsService = GPSSettingsService(
     &server,
@@ -65,9 +163,6 @@ GPSStateService gpsStateService =  GPSStateService(
     &gpsneo,
     esp32sveltekit.getFeatureService());
 
-// std::vector<TMC5160Controller*> steppers = {&stepper1, &stepper2};
-// std::vector<ClosedLoopController*> closedLoopControllers = {&closedLoopController1, &closedLoopController2};
-
 LightMqttSettingsService lightMqttSettingsService = LightMqttSettingsService(
     &server,
     esp32sveltekit.getFS(),
@@ -94,14 +189,14 @@ LightStateService lightStateService = LightStateService(
 
 // EncoderStateService encoderService = EncoderStateService(
 //     esp32sveltekit.getSocket(),
-//     &encoder1);
+//     encoders[0]);
 
 // ClosedLoopControllerService closedLoopControllerService = ClosedLoopControllerService(
 //     &server,
 //     esp32sveltekit.getSocket(),
 //     esp32sveltekit.getFS(),
 //     esp32sveltekit.getSecurityManager(),
-//     closedLoopController1);
+//     *closedLoopControllers[0]);
 
 void setup()
 {
@@ -114,6 +209,15 @@ void setup()
     server.config.max_open_sockets = 11;
     server.config.lru_purge_enable = true;
 
+    createHeliostats();
+
+#if FT_ENABLED(FT_ANALYTICS)
+    // the analytics task starts with the framework
+    esp32sveltekit.getAnalyticsService()->addSource([](JsonObject &root) {
+        for (HeliostatService *service : heliostatServices) service->readTelemetry(root);
+    });
+#endif
+
     // start ESP32-SvelteKit
     esp32sveltekit.begin();
 
@@ -123,14 +227,20 @@ void setup()
     // lightMqttSettingsService.begin();
 
     engine.init();
-    stepper1.init();
-    stepper2.init();
+    for (TMC5160Controller *stepper : steppers) stepper->init();
+
+    // each encoder is sampled by its own task
+    for (Encoder *encoder : encoders) {
+        encoder->begin();
+        encoder->startSampling(ENCODER_SAMPLE_PERIOD);
+    }
 
     gpsneo.init();
     gpsSettingsService.begin();
     gpsStateService.begin();
 
-    heliostatService.begin();
+    for (HeliostatService *service : heliostatServices) service->begin();
+    HeliostatService::startTasks();
     
     // closedLoopControllerService.begin();
 }
@@ -141,7 +251,7 @@ void loop()
 {
     // Delete Arduino loop task, as it is not needed in this example
     // vTaskDelete(NULL);
-    heliostatService.loop();
+    for (HeliostatService *service : heliostatServices) service->loop();
     unsigned long now = millis();
     if (now - lastTick > 1000) {
         lastTick = now;
@@ -152,7 +262,6 @@ void loop()
         else {
             lightStateService.updateState(LightState{true, 0.2, 0.1, 0});
         }
-        // if (encoder1.hasNewData()) Serial.println(encoder1.angle);
-        // if (encoder2.hasNewData()) Serial.println(encoder2.angle);
+        // if (encoders[0]->hasNewData()) Serial.println(encoders[0]->angle);
     }
 }
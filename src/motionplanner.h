@@ -0,0 +1,121 @@
+#ifndef MOTION_PLANNER_H
+#define MOTION_PLANNER_H
+
+#include <Arduino.h>
+
+// Position, velocity and acceleration along a move
+struct MotionState
+{
+    float position;
+    float velocity;
+    float acceleration;
+};
+
+// Jerk limited rest to rest move, in degrees and seconds. The acceleration
+// ramps up at the jerk limit, holds, and ramps down again towards the peak
+// velocity, symmetrically for the deceleration. A jerk of 0 plans a
+// trapezoidal move.
+struct SCurveProfile
+{
+    float distance = 0.f;
+    float velocity = 0.f;
+    float acceleration = 0.f;
+    float jerk = INFINITY;
+    float duration = 0.f;
+
+    static SCurveProfile plan(float distance, float maxVelocity, float maxAcceleration, float maxJerk)
+    {
+        SCurveProfile profile;
+        profile.distance = abs(distance);
+        profile.jerk = maxJerk > 0.f ? maxJerk : INFINITY;
+        profile.acceleration = maxAcceleration;
+        float jerk = profile.jerk;
+        // velocity reached when the acceleration ramp alone gets there
+        float rampVelocity = maxAcceleration * maxAcceleration / jerk;
+        float velocity = maxVelocity;
+        if (velocity * getRampTime(velocity, maxAcceleration, jerk) > profile.distance) {
+            // the peak velocity is never reached, v * ta(v) = distance
+            velocity = powf(profile.distance * sqrtf(jerk) / 2.f, 2.f / 3.f);
+            if (velocity > rampVelocity) {
+                float b = maxAcceleration / jerk;
+                velocity = 0.5f * maxAcceleration * (sqrtf(b * b + 4.f * profile.distance / maxAcceleration) - b);
+            }
+        }
+        if (velocity < rampVelocity) profile.acceleration = sqrtf(velocity * jerk);
+        profile.velocity = velocity;
+        float rampTime = getRampTime(velocity, maxAcceleration, jerk);
+        profile.duration = velocity > 0.f ? 2.f * rampTime + (profile.distance - velocity * rampTime) / velocity : 0.f;
+        return profile;
+    }
+
+    // Same path stretched over a longer duration : v / s, a / s², j / s³
+    SCurveProfile scaledTo(float newDuration)
+    {
+        SCurveProfile profile = *this;
+        if (duration <= 0.f || newDuration <= duration) return profile;
+        float s = newDuration / duration;
+        profile.velocity /= s;
+        profile.acceleration /= s * s;
+        profile.jerk /= s * s * s;
+        profile.duration = newDuration;
+        return profile;
+    }
+
+    // Distance covered while the acceleration ramps up from 0
+    float getJerkDistance()
+    {
+        return acceleration * acceleration * acceleration / (6.f * jerk * jerk);
+    }
+
+    // State at t s from the start, along the move. The deceleration mirrors
+    // the acceleration ramp.
+    MotionState getState(float t)
+    {
+        if (t <= 0.f || duration <= 0.f) return {0.f, 0.f, 0.f};
+        if (t >= duration) return {distance, 0.f, 0.f};
+        float rampTime = getRampTime(velocity, acceleration, jerk);
+        if (t <= rampTime) return getRampState(t);
+        if (t < duration - rampTime) return {velocity * (t - 0.5f * rampTime), velocity, 0.f};
+        MotionState state = getRampState(duration - t);
+        return {distance - state.position, state.velocity, -state.acceleration};
+    }
+
+    // Stretch the faster of two moves so both axes arrive together
+    static void synchronize(SCurveProfile &a, SCurveProfile &b)
+    {
+        float duration = max(a.duration, b.duration);
+        a = a.scaledTo(duration);
+        b = b.scaledTo(duration);
+    }
+
+private:
+    // Time to reach the given velocity from rest
+    static float getRampTime(float velocity, float maxAcceleration, float jerk)
+    {
+        if (velocity < maxAcceleration * maxAcceleration / jerk) return 2.f * sqrtf(velocity / jerk);
+        return velocity / maxAcceleration + maxAcceleration / jerk;
+    }
+
+    // Acceleration ramp from rest : jerk up, constant acceleration, jerk down
+    MotionState getRampState(float t)
+    {
+        float jerkTime = acceleration / jerk;
+        float holdTime = max(velocity / acceleration - jerkTime, 0.f);
+        float v1 = 0.5f * acceleration * jerkTime;
+        float p1 = acceleration * jerkTime * jerkTime / 6.f;
+        if (t < jerkTime) return {jerk * t * t * t / 6.f, 0.5f * jerk * t * t, jerk * t};
+        t -= jerkTime;
+        if (t < holdTime || jerkTime == 0.f) {
+            t = min(t, holdTime);
+            return {p1 + v1 * t + 0.5f * acceleration * t * t, v1 + acceleration * t, acceleration};
+        }
+        float v2 = v1 + acceleration * holdTime;
+        float p2 = p1 + v1 * holdTime + 0.5f * acceleration * holdTime * holdTime;
+        t = min(t - holdTime, jerkTime);
+        return {p2 + v2 * t + 0.5f * acceleration * t * t - jerk * t * t * t / 6.f,
+                v2 + acceleration * t - 0.5f * jerk * t * t,
+                acceleration - jerk * t};
+    }
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef PATH_PLANNER_H
+#define PATH_PLANNER_H
+
+#include <angle.h>
+
+// Axis travel on a continuous position measured from limitA : the allowed
+// arc runs up to limitB, the rest of the turn is forbidden. Targets in the
+// forbidden arc are clamped to the nearest limit. Moves inside the allowed
+// arc never leave it, so there is exactly one legal route. An axis found
+// inside the forbidden arc has overrun the nearest limit and goes back
+// across it, never through the rest of the forbidden arc.
+struct AxisPath
+{
+    // binary angles from origin (limitA), start may lie in the forbidden arc
+    BinaryAngle origin;
+    uint32_t start = 0;
+    uint32_t end = 0;
+    uint32_t span = 0;
+    int64_t travel = 0;
+    bool clamped = false;
+    bool escaping = false;
+
+    static AxisPath plan(BinaryAngle position, BinaryAngle target, BinaryAngle limitA, BinaryAngle limitB)
+    {
+        const int64_t turn = 1LL << 32;
+        AxisPath path;
+        path.origin = limitA;
+        path.start = (position - limitA).value;
+        path.end = (target - limitA).value;
+        path.span = (limitB - limitA).value;
+        if (path.end > path.span) {
+            path.clamped = true;
+            path.end = path.end - path.span <= turn - path.end ? path.span : 0;
+        }
+        if (path.start <= path.span) path.travel = int64_t(path.end) - int64_t(path.start);
+        else {
+            path.escaping = true;
+            if (path.start - path.span <= turn - path.start) path.travel = int64_t(path.end) - int64_t(path.start);
+            else path.travel = turn - path.start + path.end;
+        }
+        return path;
+    }
+
+    // Unconstrained axis, the shortest way round
+    static AxisPath plan(BinaryAngle position, BinaryAngle target)
+    {
+        AxisPath path;
+        path.start = position.value;
+        path.end = target.value;
+        path.span = UINT32_MAX;
+        path.travel = target.distance(position);
+        return path;
+    }
+
+    float getTravel() const {return travel * (360.f / 4294967296.f);}
+    float getStart() const {return (origin + BinaryAngle{start}).toDegrees();}
+    float getEnd() const {return (origin + BinaryAngle{end}).toDegrees();}
+    float getSpan() const {return span * (360.f / 4294967296.f);}
+};
+
+#endif
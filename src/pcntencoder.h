@@ -0,0 +1,55 @@
+#ifndef PCNT_ENCODER_H
+#define PCNT_ENCODER_H
+
+#include <encoder.h>
+#include <driver/pcnt.h>
+
+// Quadrature encoder counted in x4 by a PCNT unit. The counter limits are
+// set to one turn, so the hardware wraps the count and a read is a register
+// access. The position is relative to power on, set the controller offset
+// after homing. countsPerTurn must stay below 32768.
+class PCNTEncoder : public Encoder
+{
+public:
+    PCNTEncoder(int A, int B, uint32_t countsPerTurn, pcnt_unit_t unit = PCNT_UNIT_0) :
+        Encoder(countsPerTurn), A(A), B(B), unit(unit) {}
+
+    void begin() override {
+        pcnt_config_t config = {};
+        config.pulse_gpio_num = A;
+        config.ctrl_gpio_num = B;
+        config.channel = PCNT_CHANNEL_0;
+        config.unit = unit;
+        config.pos_mode = PCNT_COUNT_DEC;
+        config.neg_mode = PCNT_COUNT_INC;
+        config.lctrl_mode = PCNT_MODE_REVERSE;
+        config.hctrl_mode = PCNT_MODE_KEEP;
+        config.counter_h_lim = countsPerTurn;
+        config.counter_l_lim = -int32_t(countsPerTurn);
+        pcnt_unit_config(&config);
+        config.pulse_gpio_num = B;
+        config.ctrl_gpio_num = A;
+        config.channel = PCNT_CHANNEL_1;
+        config.pos_mode = PCNT_COUNT_INC;
+        config.neg_mode = PCNT_COUNT_DEC;
+        pcnt_unit_config(&config);
+        // glitch filter in APB cycles
+        pcnt_set_filter_value(unit, 100);
+        pcnt_filter_enable(unit);
+        pcnt_counter_pause(unit);
+        pcnt_counter_clear(unit);
+        pcnt_counter_resume(unit);
+    }
+
+    int readEncoder() override {
+        int16_t count;
+        if (pcnt_get_counter_value(unit, &count) != ESP_OK) return -1;
+        return count < 0 ? count + int(countsPerTurn) : count;
+    }
+
+private:
+    const int A;
+    const int B;
+    const pcnt_unit_t unit;
+};
+#endif
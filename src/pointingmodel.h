@@ -0,0 +1,120 @@
+#ifndef POINTINGMODEL_H
+#define POINTINGMODEL_H
+
+#include <geometry.h>
+#include <angle.h>
+
+// Pointing error model for an azimuth / elevation mount, fitted on-device by
+// recursive least squares. Corrections in degrees, with h the altitude of the
+// mirror normal (the elevation axis is measured from the zenith):
+//   dAzimuth   = IA + CA sec h + NPAE tan h + AN sin A tan h - AW cos A tan h
+//   dElevation = IE - AN cos A - AW sin A + TF cos h
+// IA, IE : encoder zero offsets, CA : collimation, NPAE : non-perpendicular
+// axes, AN / AW : azimuth axis tilt north / west, TF : tube flexure.
+// Each observation is two scalar updates of a fixed 7x7 covariance.
+class PointingModel
+{
+public:
+    static const int size = 7;
+    enum Term {IA, IE, CA, NPAE, AN, AW, TF};
+
+    PointingModel() {reset();}
+
+    void reset()
+    {
+        for (int i = 0; i < size; i++) {
+            parameters[i] = 0.f;
+            for (int j = 0; j < size; j++) covariance[i][j] = i == j ? initialVariance : 0.f;
+        }
+        observations = 0;
+        residualSumSq = 0.f;
+    }
+
+    SphericalCoordinate getCorrection(SphericalCoordinate commanded)
+    {
+        float azimuthRow[size], elevationRow[size];
+        getRows(commanded, azimuthRow, elevationRow);
+        return {dot(azimuthRow, parameters), dot(elevationRow, parameters)};
+    }
+
+    SphericalCoordinate apply(SphericalCoordinate commanded)
+    {
+        if (!enabled) return commanded;
+        SphericalCoordinate correction = getCorrection(commanded);
+        return {commanded.azimuth + correction.azimuth, commanded.elevation + correction.elevation};
+    }
+
+    // commanded is the uncorrected reflection, observed the axis position
+    // at which the spot was found on the target
+    void observe(SphericalCoordinate commanded, SphericalCoordinate observed)
+    {
+        float azimuthRow[size], elevationRow[size];
+        getRows(commanded, azimuthRow, elevationRow);
+        float azimuthError = (BinaryAngle::fromDegrees(observed.azimuth) - BinaryAngle::fromDegrees(commanded.azimuth)).toSignedDegrees();
+        float elevationError = observed.elevation - commanded.elevation;
+        float azimuthResidual = update(azimuthRow, azimuthError);
+        float elevationResidual = update(elevationRow, elevationError);
+        residualSumSq += azimuthResidual * azimuthResidual + elevationResidual * elevationResidual;
+        observations++;
+    }
+
+    float getResidualRMS()
+    {
+        return observations > 0 ? sqrtf(residualSumSq / observations) : 0.f;
+    }
+
+    bool enabled = false;
+    // forgetting factor, below 1 to follow a mount that keeps settling
+    float forgetting = 1.f;
+    float initialVariance = 100.f;
+    // sec h and tan h are clamped near the zenith
+    float maxAltitude = 85.f;
+    float parameters[size];
+    float covariance[size][size];
+    uint32_t observations = 0;
+
+private:
+    void getRows(SphericalCoordinate commanded, float *azimuthRow, float *elevationRow)
+    {
+        float azimuth = degToRad(float(commanded.azimuth));
+        float altitude = degToRad(min(90.f - float(commanded.elevation), maxAltitude));
+        float sinA = sinf(azimuth), cosA = cosf(azimuth);
+        float cosH = cosf(altitude), tanH = tanf(altitude);
+        float azimuthValues[size] = {1.f, 0.f, 1.f / cosH, tanH, sinA * tanH, -cosA * tanH, 0.f};
+        // the elevation axis counts down from the zenith, so its error is -dElevation
+        float elevationValues[size] = {0.f, -1.f, 0.f, 0.f, cosA, sinA, -cosH};
+        for (int i = 0; i < size; i++) {
+            azimuthRow[i] = azimuthValues[i];
+            elevationRow[i] = elevationValues[i];
+        }
+    }
+
+    float dot(const float *a, const float *b)
+    {
+        float sum = 0.f;
+        for (int i = 0; i < size; i++) sum += a[i] * b[i];
+        return sum;
+    }
+
+    // returns the a priori residual
+    float update(const float *row, float measurement)
+    {
+        float gain[size];
+        for (int i = 0; i < size; i++) gain[i] = dot(covariance[i], row);
+        float denominator = forgetting + dot(row, gain);
+        float residual = measurement - dot(row, parameters);
+        for (int i = 0; i < size; i++) parameters[i] += gain[i] * residual / denominator;
+        for (int i = 0; i < size; i++) {
+            for (int j = i; j < size; j++) {
+                float value = (covariance[i][j] - gain[i] * gain[j] / denominator) / forgetting;
+                covariance[i][j] = value;
+                covariance[j][i] = value;
+            }
+        }
+        return residual;
+    }
+
+    float residualSumSq = 0.f;
+};
+
+#endif
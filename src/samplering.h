@@ -0,0 +1,74 @@
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <algorithm>
+#include <atomic>
+#include <stdint.h>
+
+// Single producer ring of the last N samples. The producer never waits; a
+// reader copies an entry and checks the producer did not lap it meanwhile.
+// head is the sequence : stored with release after the payload, so a reader
+// that loads it with acquire sees the entries it counts, and the release
+// fence before the payload makes an overwrite visible as a head change.
+template<typename T, int N>
+class SampleRing
+{
+    static_assert((N & (N - 1)) == 0, "N must be a power of two");
+public:
+    void push(const T &sample) {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        // the previous head store is ordered before the slot is overwritten
+        std::atomic_thread_fence(std::memory_order_release);
+        items[h & (N - 1)] = sample;
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    // Copies up to n samples, newest first, returns the number copied
+    int recent(T *out, int n) {
+        while (true) {
+            uint32_t h = head.load(std::memory_order_acquire);
+            int count = std::min(n, int(std::min(h, uint32_t(N - 1))));
+            for (int i = 0; i < count; i++) out[i] = items[(h - 1 - i) & (N - 1)];
+            std::atomic_thread_fence(std::memory_order_acquire);
+            // the producer may overwrite the entry after head, never older ones
+            if (head.load(std::memory_order_relaxed) - h < uint32_t(N - count)) return count;
+        }
+    }
+
+    // Copies up to n samples from the index cursor on, oldest first, and
+    // advances the cursor. Samples overwritten before they were read are
+    // skipped, the returned count excludes them.
+    int from(uint32_t &cursor, T *out, int n) {
+        while (true) {
+            uint32_t h = head.load(std::memory_order_acquire);
+            uint32_t first = h - cursor > uint32_t(N - 1) ? h - (N - 1) : cursor;
+            int count = std::min(n, int(h - first));
+            for (int i = 0; i < count; i++) out[i] = items[(first + i) & (N - 1)];
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (head.load(std::memory_order_relaxed) - first <= uint32_t(N - 1)) {
+                cursor = first + count;
+                return count;
+            }
+        }
+    }
+
+    bool latest(T &out) {
+        while (true) {
+            uint32_t h = head.load(std::memory_order_acquire);
+            if (h == 0) return false;
+            out = items[(h - 1) & (N - 1)];
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (head.load(std::memory_order_relaxed) - h < uint32_t(N - 1)) return true;
+        }
+    }
+
+    uint32_t size() {
+        return head.load(std::memory_order_acquire);
+    }
+
+private:
+    T items[N];
+    std::atomic<uint32_t> head{0};
+};
+
+#endif
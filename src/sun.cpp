@@ -2,6 +2,7 @@
 
 void setupSolarTracker() {
     SolarPosition::setTimeProvider(now);
+    SolarEphemeris::startTask();
 }
 
 SphericalCoordinate computeSolarPosition(double latitude, double longitude) {
@@ -10,4 +11,156 @@ SphericalCoordinate computeSolarPosition(double latitude, double longitude) {
     ESP_LOGI("Sun", "%f %f", latitude, longitude);
     ESP_LOGI("Sun", "%f %f", currentSolarPosition.azimuth, currentSolarPosition.elevation);
     return {currentSolarPosition.azimuth, currentSolarPosition.elevation};
-}
\ No newline at end of file
+}
+
+SphericalCoordinate computeSolarPosition(double latitude, double longitude, time_t t) {
+    SolarPosition position(latitude, longitude);
+    SolarPosition_t solarPosition = position.getSolarPosition(t);
+    return {solarPosition.azimuth, solarPosition.elevation};
+}
+
+QueueHandle_t SolarEphemeris::_queue = nullptr;
+TaskHandle_t SolarEphemeris::_task = nullptr;
+
+SolarEphemeris::SolarEphemeris() : mutex(xSemaphoreCreateMutex()) {}
+
+SolarEphemeris &SolarEphemeris::shared() {
+    static SolarEphemeris ephemeris;
+    return ephemeris;
+}
+
+void SolarEphemeris::startTask() {
+    if (_task != nullptr) return;
+    _queue = xQueueCreate(8, sizeof(SolarEphemeris *));
+    xTaskCreatePinnedToCore(
+        _loop,                      // Function that should be called
+        "Solar Ephemeris",          // Name of the task (for debugging)
+        4096,                       // Stack size (bytes)
+        NULL,                       // Tables come through the queue
+        (tskIDLE_PRIORITY + 1),     // well below the control task
+        &_task,                     // Task handle
+        tskNO_AFFINITY              // Any core
+    );
+}
+
+void SolarEphemeris::_loop(void *) {
+    SolarEphemeris *ephemeris;
+    while (1) {
+        if (xQueueReceive(_queue, &ephemeris, portMAX_DELAY) == pdTRUE) ephemeris->update();
+    }
+}
+
+SphericalCoordinate SolarEphemeris::getPosition(double latitude, double longitude) {
+    return getPosition(latitude, longitude, now());
+}
+
+SphericalCoordinate SolarEphemeris::getPosition(double latitude, double longitude, double t) {
+    time_t day = previousMidnight(time_t(t));
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    int i = find(latitude, longitude, day);
+    if (i < 0) {
+        request(latitude, longitude, day);
+        misses++;
+        xSemaphoreGive(mutex);
+        return computeSolarPosition(latitude, longitude, time_t(t));
+    }
+    current = i;
+    Table &table = tables[i];
+    double u = (t - table.day) / tableStep;
+    int index = int(u);
+    float fract = u - index;
+    double azimuth = interpolate(table.azimuths, index, fract);
+    double elevation = interpolate(table.elevations, index, fract);
+    if (t - day >= SECS_PER_DAY - prefetch && find(latitude, longitude, day + SECS_PER_DAY) < 0) {
+        request(latitude, longitude, day + SECS_PER_DAY);
+    }
+    xSemaphoreGive(mutex);
+    return {azimuth - 360. * floor(azimuth / 360.), elevation};
+}
+
+bool SolarEphemeris::isValid() {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    bool valid = tables[0].valid || tables[1].valid;
+    xSemaphoreGive(mutex);
+    return valid;
+}
+
+void SolarEphemeris::invalidate() {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    tables[0].valid = false;
+    tables[1].valid = false;
+    xSemaphoreGive(mutex);
+}
+
+int SolarEphemeris::find(double latitude, double longitude, time_t day) {
+    for (int i = 0; i < 2; i++) {
+        Table &table = tables[i];
+        if (table.valid && table.day == day && table.latitude == latitude && table.longitude == longitude) return i;
+    }
+    return -1;
+}
+
+// Called with the mutex held. The latest request replaces a pending one.
+void SolarEphemeris::request(double latitude, double longitude, time_t day) {
+    pendingLatitude = latitude;
+    pendingLongitude = longitude;
+    pendingDay = day;
+    pending = true;
+    SolarEphemeris *self = this;
+    if (!queued && _queue != nullptr && xQueueSend(_queue, &self, 0) == pdTRUE) queued = true;
+}
+
+bool SolarEphemeris::update() {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    queued = false;
+    if (!pending) {
+        xSemaphoreGive(mutex);
+        return false;
+    }
+    pending = false;
+    double latitude = pendingLatitude;
+    double longitude = pendingLongitude;
+    time_t day = pendingDay;
+    // readers only use valid tables, so the invalidated one is ours until
+    // it is marked valid again
+    int i = tables[current].valid ? 1 - current : current;
+    Table &table = tables[i];
+    table.valid = false;
+    xSemaphoreGive(mutex);
+
+    build(table, latitude, longitude, day);
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    table.latitude = latitude;
+    table.longitude = longitude;
+    table.day = day;
+    table.valid = true;
+    buildCount++;
+    xSemaphoreGive(mutex);
+    ESP_LOGI("Sun", "Ephemeris table built for %f %f", latitude, longitude);
+    return true;
+}
+
+void SolarEphemeris::build(Table &table, double latitude, double longitude, time_t day) {
+    SolarPosition position(latitude, longitude);
+    for (int i = 0; i < tableSize; i++) {
+        SolarPosition_t sample = position.getSolarPosition(day + (i - 1) * tableStep);
+        float azimuth = sample.azimuth;
+        if (i > 0) {
+            // keep the table continuous across the 0/360 crossing
+            while (azimuth - table.azimuths[i - 1] > 180.f) azimuth -= 360.f;
+            while (azimuth - table.azimuths[i - 1] < -180.f) azimuth += 360.f;
+        }
+        table.azimuths[i] = azimuth;
+        table.elevations[i] = sample.elevation;
+    }
+}
+
+float SolarEphemeris::interpolate(const float *table, int index, float fract) {
+    // table[index + 1] is the sample at day + index * tableStep
+    float p0 = table[index];
+    float p1 = table[index + 1];
+    float p2 = table[index + 2];
+    float p3 = table[index + 3];
+    return p1 + 0.5f * fract * (p2 - p0 + fract * (2.f * p0 - 5.f * p1 + 4.f * p2 - p3 + fract * (3.f * (p1 - p2) + p3 - p0)));
+}
@@ -1,8 +1,78 @@
 #ifndef SUNTRACKER
 #define SUNTRACKER
+#include <Arduino.h>
 #include <SolarPosition.h>
 #include "TimeLib.h"
 #include "geometry.h"
 SphericalCoordinate computeSolarPosition(double latitude, double longitude);
+SphericalCoordinate computeSolarPosition(double latitude, double longitude, time_t t);
 void setupSolarTracker();
-#endif
\ No newline at end of file
+
+// Solar ephemeris cache. The full SolarPosition computation is run once per
+// table sample for a UTC day, queries are answered by Catmull-Rom
+// interpolation between samples. With 5 min samples the interpolation error
+// stays well below 0.01° in elevation; azimuth is stored unwrapped so the
+// 0/360 crossing is continuous.
+//
+// Tables are built by a low priority task, never by the caller: a query the
+// tables don't cover is answered by one direct computation and queues the
+// build. There are two tables, so the next day is built ahead of midnight
+// while the current one is still in use.
+class SolarEphemeris
+{
+public:
+    static const int tableStep = 300;
+    static const int tableSize = SECS_PER_DAY / tableStep + 3;
+    // s before midnight from which the next day is queued
+    static const int prefetch = 3600;
+
+    SolarEphemeris();
+
+    // One table for all the mirrors of a board, they share the site
+    static SolarEphemeris &shared();
+    // Starts the builder task, tables are only built by update() until then
+    static void startTask();
+
+    SphericalCoordinate getPosition(double latitude, double longitude);
+    SphericalCoordinate getPosition(double latitude, double longitude, double t);
+    // Builds the queued table, if any. Runs in the builder task.
+    bool update();
+    bool isValid();
+    uint32_t getBuildCount() {return buildCount;}
+    // queries answered without a table
+    uint32_t getMisses() {return misses;}
+    void invalidate();
+
+private:
+    struct Table
+    {
+        float azimuths[tableSize];
+        float elevations[tableSize];
+        double latitude = 0.;
+        double longitude = 0.;
+        time_t day = 0;
+        bool valid = false;
+    };
+
+    int find(double latitude, double longitude, time_t day);
+    void request(double latitude, double longitude, time_t day);
+    void build(Table &table, double latitude, double longitude, time_t day);
+    float interpolate(const float *table, int index, float fract);
+
+    Table tables[2];
+    // table of the last hit, the builder fills the other one
+    int current = 0;
+    bool pending = false;
+    bool queued = false;
+    double pendingLatitude = 0.;
+    double pendingLongitude = 0.;
+    time_t pendingDay = 0;
+    uint32_t buildCount = 0;
+    uint32_t misses = 0;
+    SemaphoreHandle_t mutex;
+
+    static QueueHandle_t _queue;
+    static TaskHandle_t _task;
+    static void _loop(void *);
+};
+#endif
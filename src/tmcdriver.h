@@ -5,9 +5,21 @@
 
 #include <TMCStepper.h>
 #include "FastAccelStepper.h"
+#include <angle.h>
+#include <motionplanner.h>
+#include <tmcregisters.h>
+#include <tmcramp.h>
+#include <tmctelemetry.h>
+
+// Step generation : step / dir pulses from FastAccelStepper, or the ramp
+// generator of the TMC5160 itself over SPI
+enum class StepBackend {STEPDIR, INTERNAL};
 
 struct TMC5160Controller {
     TMC5160Stepper &driver;
+    TMC5160Registers registers;
+    TMC5160RampGenerator rampGenerator;
+    TMCTelemetry telemetry;
     FastAccelStepperEngine &engine;
     FastAccelStepper *stepper = NULL;
     bool enabled = false;
@@ -18,39 +30,62 @@ struct TMC5160Controller {
     uint16_t current = 30;
     uint32_t maxSpeed = 40;
     uint32_t maxAccel = 20;
+    // full steps/s³, 0 for trapezoidal ramps
+    uint32_t maxJerk = 80;
+    // fraction of maxAccel set by the user, planned moves override it
+    double acceleration = 1.;
+    // a planned move's ramp is in force instead of it
+    bool rampApplied = false;
+    // copies for the readers, see sampleStatus()
+    int32_t cachedPosition = 0;
+    int32_t cachedSpeed = 0;
+    StepBackend backend = StepBackend::STEPDIR;
+    // FastAccelStepper step generator type, DRIVER_RMT keeps the PCNT units
+    // free for the encoders
+    uint8_t stepDriver = DRIVER_DONT_CARE;
+    uint32_t commandCount = 0;
     const char* msteps;
     const char* pwmfr;
     const char* freewh;
     const int DIR;
     const int STEP;
 
-    TMC5160Controller(TMC5160Stepper &driver, FastAccelStepperEngine &engine, const int STEP, const int DIR) : driver {driver}, engine {engine}, STEP {STEP}, DIR {DIR} {}
+    TMC5160Controller(TMC5160Stepper &driver, FastAccelStepperEngine &engine, const int STEP, const int DIR) : driver {driver}, registers {driver}, rampGenerator {driver, registers}, engine {engine}, STEP {STEP}, DIR {DIR} {}
 
     void init() {
         pinMode(STEP, OUTPUT);
         driver.begin();                 //  SPI: Init CS pins and possible SW SPI pins
+        registers.begin();
         if (!isConnected()) Serial.println("Driver communication error");
         Serial.print("Driver firmware version: ");
-        Serial.println(driver.version());
-        if (driver.sd_mode()) Serial.println("Driver is hardware configured for Step & Dir mode");
-        if (driver.drv_enn()) Serial.println("Driver is not hardware enabled");
+        Serial.println(registers.getVersion());
+        if (registers.isStepDir()) Serial.println("Driver is hardware configured for Step & Dir mode");
+        if (!registers.isHardwareEnabled()) Serial.println("Driver is not hardware enabled");
 
 
         Serial.print("DRV_STATUS=0b");
-        Serial.println(driver.DRV_STATUS(), BIN);
+        Serial.println(registers.getDrvStatus(), BIN);
         initDriver();
 
-        stepper = engine.stepperConnectToPin(STEP);
+        stepper = engine.stepperConnectToPin(STEP, stepDriver);
         if (stepper) {
             stepper->setDirectionPin(DIR);
             stepper->setSpeedInHz(maxSpeed*microsteps);       // 200 steps/s
-            stepper->setAcceleration(maxAccel*microsteps);    // 40 steps/s²
+            setAcceleration(acceleration);                    // 40 steps/s²
+        }
+        // the engine has no step generator left for this pin
+        else if (!registers.isStepDir()) {
+            Serial.println("No step generator left, using the driver ramp generator");
+            backend = StepBackend::INTERNAL;
+            rampGenerator.begin(0);
+            setMaxSpeed();
+            setAcceleration(acceleration);
         }
         else Serial.println("Stepper ERROR");
     }
 
     bool isConnected() {
-        return !(driver.version() == 0xFF || driver.version() == 0);
+        return registers.isConnected();
     }
 
     void initDriver() {
@@ -68,40 +103,149 @@ struct TMC5160Controller {
         // stepper->attachToPulseCounter(6, -200*microsteps, 200*microsteps);
     }
     void setMaxSpeed() {
-        stepper->setSpeedInHz(maxSpeed*microsteps);
+        if (isInternal()) rampGenerator.velocity = maxSpeed*microsteps;
+        else stepper->setSpeedInHz(maxSpeed*microsteps);
+    }
+
+    // Back to maxSpeed and the user acceleration after a planned move
+    void clearRamp() {
+        setMaxSpeed();
+        if (rampApplied) setAcceleration(acceleration);
+        rampApplied = false;
+    }
+
+    // Speed, acceleration and jerk of a planned move. FastAccelStepper ramps
+    // the acceleration up linearly over the jerk distance.
+    void setRamp(SCurveProfile profile) {
+        float stepsPerDegree = stepsPerRotation * microsteps / 360.f;
+        rampApplied = true;
+        if (isInternal()) {
+            rampGenerator.velocity = profile.velocity * stepsPerDegree;
+            rampGenerator.acceleration = profile.acceleration * stepsPerDegree;
+            rampGenerator.jerk = profile.jerk * stepsPerDegree;
+            return;
+        }
+        stepper->setSpeedInMilliHz(max(uint32_t(profile.velocity * stepsPerDegree * 1000.f), 1u));
+        stepper->setAcceleration(max(int32_t(profile.acceleration * stepsPerDegree), 1));
+        stepper->setLinearAcceleration(uint32_t(profile.getJerkDistance() * stepsPerDegree));
     }
 
     void setMaxSpeed(uint32_t sp) {
-        stepper->setSpeedInHz(sp*microsteps);
+        setSpeedInMilliHz(sp*microsteps*1000);
     }
 
     uint32_t getMaxSpeed() {
+        if (isInternal()) return rampGenerator.velocity/microsteps;
         return stepper->getSpeedInMilliHz()/(1000*microsteps);
     }
 
+    bool isInternal() {
+        return backend == StepBackend::INTERNAL;
+    }
+
+    // Switches the step generation while at rest, carrying the position over.
+    // The internal ramp generator needs the SD_MODE pin low.
+    bool setBackend(StepBackend newBackend) {
+        if (newBackend == backend) return true;
+        if (newBackend == StepBackend::STEPDIR && stepper == NULL) return false;
+        if (getCurrentSpeedInMilliHz() != 0) return false;
+        if (newBackend == StepBackend::INTERNAL && registers.isStepDir()) {
+            ESP_LOGI("Driver", "SD_MODE is high, the internal ramp generator is unavailable");
+            return false;
+        }
+        int32_t position = getCurrentPosition();
+        if (newBackend == StepBackend::INTERNAL) rampGenerator.begin(position);
+        else stepper->setCurrentPosition(position);
+        backend = newBackend;
+        setMaxSpeed();
+        setAcceleration(acceleration);
+        return true;
+    }
+
+    int32_t getCurrentPosition() {
+        return isInternal() ? rampGenerator.getPosition() : stepper->getCurrentPosition();
+    }
+
+    int32_t targetPos() {
+        return isInternal() ? rampGenerator.getTarget() : stepper->targetPos();
+    }
+
+    int32_t getCurrentSpeedInMilliHz() {
+        return isInternal() ? int32_t(rampGenerator.getVelocity() * 1000.f) : stepper->getCurrentSpeedInMilliHz();
+    }
+
+    void setSpeedInMilliHz(uint32_t speed) {
+        if (isInternal()) rampGenerator.velocity = speed * 0.001f;
+        else stepper->setSpeedInMilliHz(speed);
+    }
+
+    void moveTo(int32_t position) {
+        if (isInternal()) rampGenerator.moveTo(position);
+        else stepper->moveTo(position);
+    }
+
+    void run(bool forward) {
+        if (isInternal()) rampGenerator.run(forward ? rampGenerator.velocity : -rampGenerator.velocity);
+        else if (forward) stepper->runForward();
+        else stepper->runBackward();
+    }
+
+    void stopMove() {
+        if (isInternal()) rampGenerator.stop();
+        else stepper->stopMove();
+    }
+
     void setSpeed(double sp) {
         sp = min(max(-1., sp), 1.);
         // Serial.print("Set : ");
         // Serial.println(sp);
-        if (sp == 0) stepper->stopMove();
+        if (sp == 0) stopMove();
         else {
             setMaxSpeed(abs(sp*maxSpeed));
-            if (sp < 0) stepper->runBackward();
-            else stepper->runForward();
+            run(sp > 0);
         }
     }
 
     void setSpeed(int32_t sp) {
-        if (sp == 0) stepper->stopMove();
+        if (sp == 0) stopMove();
         else {
             setMaxSpeed(abs(sp));
-            if (sp < 0) stepper->runBackward();
-            else stepper->runForward();
+            run(sp > 0);
         }
     }
 
+    float getMaxVelocity() {
+        return maxSpeed * 360.f / stepsPerRotation;
+    }
+
+    float getMaxAcceleration() {
+        return maxAccel * 360.f / stepsPerRotation;
+    }
+
+    float getMaxJerk() {
+        return maxJerk * 360.f / stepsPerRotation;
+    }
+
+    // Continuous run at the given angular velocity in °/s, clamped to maxSpeed
+    void setVelocity(float velocity) {
+        float maxVelocity = getMaxVelocity();
+        velocity = min(max(-maxVelocity, velocity), maxVelocity);
+        uint32_t speed = abs(velocity) * stepsPerRotation / 360.f * microsteps * 1000.f;
+        commandCount++;
+        if (speed == 0) stopMove();
+        else {
+            setSpeedInMilliHz(speed);
+            run(velocity > 0);
+        }
+    }
+
+    // Current velocity in °/s
+    float getVelocity() {
+        return getCurrentSpeedInMilliHz() * 0.001f * 360.f / (microsteps * stepsPerRotation);
+    }
+
     double getSpeed() {
-        return double(stepper->getCurrentSpeedInMilliHz())/double(1000*microsteps*maxSpeed);
+        return double(getCurrentSpeedInMilliHz())/double(1000*microsteps*maxSpeed);
     }
 
     void stop() {
@@ -109,35 +253,25 @@ struct TMC5160Controller {
     }
 
     int32_t move() {
-        return (stepper->targetPos()-stepper->getCurrentPosition())/microsteps;
+        return (targetPos()-getCurrentPosition())/microsteps;
     }
 
     void moveR(int32_t move) {
-        stepper->moveTo(stepper->getCurrentPosition() + move * microsteps);
+        moveTo(getCurrentPosition() + move * microsteps);
     }
 
     void moveR(double angle) {
-        stepper->moveTo(stepper->getCurrentPosition() + angle*stepsPerRotation/360. * microsteps);
+        commandCount++;
+        moveTo(getCurrentPosition() + angle*stepsPerRotation/360. * microsteps);
         // ESP_LOGI("Driver", "MoveR %f", angle);
-        // Serial.println(driver.XACTUAL());
-        // driver.RAMPMODE(0);
-        // driver.VSTART(100);
-        // driver.AMAX(stepper->getAcceleration());
-        // driver.a1(stepper->getAcceleration());
-        // driver.VMAX(stepper->getMaxSpeedInHz());
-        // driver.v1(stepper->getMaxSpeedInHz());
-        // driver.DMAX(stepper->getMaxSpeedInHz());
-        // driver.d1(stepper->getMaxSpeedInHz());
-        // driver.VSTOP(100);
-        // driver.XTARGET(driver.XACTUAL() + angle*stepsPerRotation/360. * microsteps);
     }
 
     void move(double angle) {
-        stepper->move((angle*stepsPerRotation/360.-double(this->move()))*microsteps);
+        moveTo(targetPos() + (angle*stepsPerRotation/360.-double(this->move()))*microsteps);
     }
 
     void move(int32_t move) {
-        stepper->move((move-this->move())*microsteps);
+        moveTo(targetPos() + (move-this->move())*microsteps);
     }
 
     double mod(double a, double N) {return a - N*floor(a/N);}
@@ -148,50 +282,100 @@ struct TMC5160Controller {
     }
 
     double getAngle() {
-        return mod(stepper->getCurrentPosition()*360./double(microsteps*stepsPerRotation), 360.);
+        return mod(getCurrentPosition()*360./double(microsteps*stepsPerRotation), 360.);
+    }
+
+    // Moves the step count, and the target with it, after lost steps
+    void shiftPosition(float degrees) {
+        int32_t steps = lroundf(degrees * stepsPerRotation * microsteps / 360.f);
+        if (isInternal()) rampGenerator.shift(steps);
+        else stepper->setCurrentPosition(stepper->getCurrentPosition() + steps);
+    }
+
+    BinaryAngle getPosition() {
+        return BinaryAngle{uint32_t(int64_t(getCurrentPosition()) * 4294967296LL / (microsteps * stepsPerRotation))};
     }
 
     double getTargetAngle() {
-        return mod(stepper->targetPos()*360./double(microsteps), 360.);
+        return mod(targetPos()*360./double(microsteps), 360.);
+    }
+
+    // Runs in the control task. The status registers, position and speed
+    // are refreshed together at most every registers.statusTTL into the
+    // copies the service readers use. Returns true when they were.
+    bool sampleStatus() {
+        telemetry.sample(registers, millis());
+        if (!registers.poll()) return false;
+        cachedPosition = getCurrentPosition();
+        cachedSpeed = getCurrentSpeedInMilliHz();
+        return true;
+    }
+
+    // Position, velocity in °/s and speed as a fraction of maxSpeed from the
+    // last sampleStatus()
+    BinaryAngle getCachedPosition() {
+        return BinaryAngle{uint32_t(int64_t(cachedPosition) * 4294967296LL / (microsteps * stepsPerRotation))};
+    }
+
+    float getCachedVelocity() {
+        return cachedSpeed * 0.001f * 360.f / (microsteps * stepsPerRotation);
+    }
+
+    double getCachedSpeed() {
+        return double(cachedSpeed)/double(1000*microsteps*maxSpeed);
     }
 
     uint32_t getStatus() {
-        return driver.DRV_STATUS();
+        return registers.getDrvStatus();
     }
 
     void enable() {
-        driver.toff(3);
+        registers.setToff(3);
         enabled = true;
     }
 
     bool isEnabled() {
-        return driver.isEnabled();
+        return registers.isEnabled();
     }
 
     void disable() {
-        driver.toff(0);
+        registers.setToff(0);
         enabled = false;
     }
 
     void setMicroSteps(uint16_t ms) {
         microsteps = ms;
-        driver.microsteps(ms);
+        registers.setMicrosteps(ms);
     }
 
     const char* getMicroSteps() {
-        uint16_t m = driver.microsteps();
+        uint16_t m = registers.getMicrosteps();
         microsteps = m ? m : 1;
         if (msteps != NULL) free((char*)msteps);
         msteps = strdup(String(microsteps).c_str());
         return msteps;
     }
 
+    // Acceleration as a fraction of maxAccel, with the jerk ramp that goes
+    // with it. Kept for unplanned moves, see clearRamp().
     void setAcceleration(double acc) {
-        stepper->setAcceleration(acc*maxAccel*microsteps);
+        acceleration = acc;
+        rampApplied = false;
+        if (isInternal()) {
+            rampGenerator.acceleration = acc*maxAccel*microsteps;
+            rampGenerator.jerk = maxJerk*microsteps;
+            return;
+        }
+        if (stepper == NULL) return;
+        float accel = acc * maxAccel;
+        stepper->setAcceleration(max(int32_t(accel*microsteps), 1));
+        // steps while the acceleration ramps up at the jerk limit, a³ / 6j²
+        float linearSteps = maxJerk > 0 ? accel * accel * accel / (6.f * maxJerk * maxJerk) : 0.f;
+        stepper->setLinearAcceleration(linearSteps * microsteps);
     }
 
     double getAcceleration() {
-        return double(stepper->getAcceleration())/double(microsteps*maxAccel);
+        return acceleration;
     }
 
     uint32_t getStepsToStop() {
@@ -0,0 +1,158 @@
+#ifndef TMCRAMP_H
+#define TMCRAMP_H
+
+#include <Arduino.h>
+#include <TMCStepper.h>
+#include <tmcregisters.h>
+
+// TMC5160 internal motion controller, driven over SPI. Positions are in
+// microsteps, velocities in microsteps/s and accelerations in microsteps/s²,
+// converted to register units with the driver clock. The six point ramp
+// accelerates at A1 up to V1 and at AMAX above it, V1 being the velocity at
+// which a jerk limited ramp reaches full acceleration. Limits are only
+// written to the chip when a move or run is started, and only when changed.
+class TMC5160RampGenerator
+{
+public:
+    enum RampMode : uint8_t {POSITION = 0, VELOCITY_POSITIVE = 1, VELOCITY_NEGATIVE = 2, HOLD = 3};
+
+    TMC5160Stepper &driver;
+    TMC5160Registers &registers;
+    // internal oscillator, or the frequency on the CLK pin
+    float clock = 12000000.f;
+    float velocity = 0.f;
+    float acceleration = 0.f;
+    float jerk = 0.f;
+
+    TMC5160RampGenerator(TMC5160Stepper &driver, TMC5160Registers &registers) : driver {driver}, registers {registers} {}
+
+    // Takes over at the given position, holding it
+    void begin(int32_t position) {
+        driver.VSTART(0);
+        driver.VSTOP(10);
+        driver.VMAX(0);
+        driver.RAMPMODE(POSITION);
+        driver.XACTUAL(position);
+        driver.XTARGET(position);
+        registers.spiTransactions += 6;
+        mode = POSITION;
+        target = position;
+        written = unknown;
+        written.vmax = 0;
+        apply();
+    }
+
+    void moveTo(int32_t position) {
+        apply();
+        if (mode != POSITION) {
+            driver.RAMPMODE(POSITION);
+            registers.spiTransactions++;
+            mode = POSITION;
+        }
+        writeVelocity(toVelocity(velocity));
+        driver.XTARGET(position);
+        registers.spiTransactions++;
+        target = position;
+    }
+
+    // Velocity mode, signed microsteps/s, accelerating at AMAX
+    void run(float speed) {
+        apply();
+        RampMode runMode = speed < 0.f ? VELOCITY_NEGATIVE : VELOCITY_POSITIVE;
+        writeVelocity(toVelocity(abs(speed)));
+        if (mode != runMode) {
+            driver.RAMPMODE(runMode);
+            registers.spiTransactions++;
+            mode = runMode;
+        }
+    }
+
+    // Decelerates to standstill in velocity mode
+    void stop() {
+        run(0.f);
+    }
+
+    int32_t getPosition() {
+        registers.spiTransactions++;
+        return driver.XACTUAL();
+    }
+
+    int32_t getTarget() {
+        return mode == POSITION ? target : getPosition();
+    }
+
+    // Moves the position, and the target with it
+    void shift(int32_t steps) {
+        driver.XACTUAL(getPosition() + steps);
+        registers.spiTransactions++;
+        if (mode == POSITION) {
+            target += steps;
+            driver.XTARGET(target);
+            registers.spiTransactions++;
+        }
+    }
+
+    // Signed microsteps/s
+    float getVelocity() {
+        registers.spiTransactions++;
+        // VACTUAL is a 24 bit two's complement value
+        int32_t value = int32_t(uint32_t(driver.VACTUAL()) << 8) >> 8;
+        return value * clock / 16777216.f;
+    }
+
+    uint32_t toVelocity(float speed) {
+        return constrain(speed * 16777216.f / clock, 0.f, 8388096.f);
+    }
+
+    uint16_t toAcceleration(float accel) {
+        return constrain(accel * 2199023255552.f / (clock * clock), 1.f, 65535.f);
+    }
+
+private:
+    struct Limits {
+        uint16_t amax;
+        uint16_t a1;
+        uint32_t v1;
+        uint32_t vmax;
+    };
+
+    RampMode mode = POSITION;
+    int32_t target = 0;
+    // never produced by apply(), forces the first write
+    static constexpr Limits unknown = {0, 0, 0xFFFFFFFF, 0xFFFFFFFF};
+    Limits written = unknown;
+
+    void apply() {
+        uint16_t amax = toAcceleration(acceleration);
+        // a jerk limited ramp reaches full acceleration at a² / 2j
+        uint32_t v1 = jerk > 0.f ? min(toVelocity(acceleration * acceleration / (2.f * jerk)), toVelocity(velocity)) : 0;
+        uint16_t a1 = max(amax / 2, 1);
+        if (amax != written.amax) {
+            driver.AMAX(amax);
+            driver.DMAX(amax);
+            registers.spiTransactions += 2;
+            written.amax = amax;
+        }
+        if (a1 != written.a1) {
+            // D1 must not be 0 in positioning mode, even without V1
+            driver.a1(a1);
+            driver.d1(a1);
+            registers.spiTransactions += 2;
+            written.a1 = a1;
+        }
+        if (v1 != written.v1) {
+            driver.v1(v1);
+            registers.spiTransactions++;
+            written.v1 = v1;
+        }
+    }
+
+    void writeVelocity(uint32_t vmax) {
+        if (vmax == written.vmax) return;
+        driver.VMAX(vmax);
+        registers.spiTransactions++;
+        written.vmax = vmax;
+    }
+};
+
+#endif
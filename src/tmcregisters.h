@@ -0,0 +1,110 @@
+#ifndef TMCREGISTERS_H
+#define TMCREGISTERS_H
+
+#include <Arduino.h>
+#include <TMCStepper.h>
+
+// Shadow copies of the TMC5160 registers the services read. Configuration
+// registers are written through and read back from the copy, status registers
+// are polled together at most once per statusTTL by the control task. The
+// getters only return the copies, so UI refreshes and HTTP reads never touch
+// the SPI bus.
+class TMC5160Registers
+{
+public:
+    // IOIN bits
+    static const uint32_t DRV_ENN = 1u << 4;
+    static const uint32_t SD_MODE = 1u << 6;
+
+    TMC5160Stepper &driver;
+    uint32_t statusTTL = 100;
+    // register accesses issued through the shadow layer
+    uint32_t spiTransactions = 0;
+    uint32_t polls = 0;
+
+    TMC5160Registers(TMC5160Stepper &driver) : driver {driver} {}
+
+    // Reads the configuration once, after driver.begin()
+    void begin() {
+        refresh();
+        version = ioin >> 24;
+        shaft = driver.shaft();
+        toff = driver.toff();
+        microsteps = driver.microsteps();
+        rmsCurrent = driver.rms_current();
+        spiTransactions += 4;
+    }
+
+    // Status registers, read back to back
+    void refresh() {
+        ioin = driver.IOIN();
+        drvStatus = driver.DRV_STATUS();
+        spiTransactions += 2;
+        polls++;
+        lastPoll = millis();
+    }
+
+    // DRV_STATUS alone, for the telemetry sampler
+    uint32_t readDrvStatus() {
+        drvStatus = driver.DRV_STATUS();
+        spiTransactions++;
+        return drvStatus;
+    }
+
+    // Returns true when the status was read
+    bool poll() {
+        if (millis() - lastPoll < statusTTL) return false;
+        refresh();
+        return true;
+    }
+
+    uint32_t getDrvStatus() {return drvStatus;}
+    uint32_t getIOIN() {return ioin;}
+
+    uint8_t getVersion() {return version;}
+    bool isConnected() {return !(version == 0xFF || version == 0);}
+    bool isStepDir() {return getIOIN() & SD_MODE;}
+    bool isHardwareEnabled() {return !(getIOIN() & DRV_ENN);}
+    bool isEnabled() {return isHardwareEnabled() && toff > 0;}
+
+    bool getShaft() {return shaft;}
+    void setShaft(bool value) {
+        driver.shaft(value);
+        shaft = value;
+        spiTransactions++;
+    }
+
+    uint8_t getToff() {return toff;}
+    void setToff(uint8_t value) {
+        driver.toff(value);
+        toff = value;
+        spiTransactions++;
+    }
+
+    uint16_t getMicrosteps() {return microsteps;}
+    void setMicrosteps(uint16_t value) {
+        driver.microsteps(value);
+        microsteps = driver.microsteps();
+        spiTransactions += 2;
+    }
+
+    uint16_t getRmsCurrent() {return rmsCurrent;}
+    void setRmsCurrent(uint16_t value) {
+        driver.rms_current(value);
+        // the driver rounds to its current scale
+        rmsCurrent = driver.rms_current();
+        spiTransactions += 2;
+    }
+
+private:
+    uint8_t version = 0;
+    bool shaft = false;
+    uint8_t toff = 0;
+    uint16_t microsteps = 256;
+    uint16_t rmsCurrent = 0;
+    uint32_t ioin = 0;
+    uint32_t drvStatus = 0;
+    uint32_t lastPoll = 0;
+};
+
+#endif
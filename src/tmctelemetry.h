@@ -0,0 +1,120 @@
+#ifndef TMCTELEMETRY_H
+#define TMCTELEMETRY_H
+
+#include <Arduino.h>
+#include <tmcregisters.h>
+#include <samplering.h>
+
+// One decoded DRV_STATUS sample, packed little endian into 8 bytes as it is
+// streamed. load is SG_RESULT, lower values mean more mechanical load.
+struct __attribute__((packed)) TelemetryRecord
+{
+    enum Flags : uint8_t {
+        STANDSTILL = 1 << 0,
+        OVERTEMPERATURE = 1 << 1,
+        PREWARNING = 1 << 2,
+        OPEN_LOAD_A = 1 << 3,
+        OPEN_LOAD_B = 1 << 4,
+        STALL = 1 << 5,
+    };
+
+    uint32_t time;
+    uint16_t load;
+    uint8_t current;
+    uint8_t flags;
+
+    static TelemetryRecord decode(uint32_t status, uint32_t time)
+    {
+        TelemetryRecord record;
+        record.time = time;
+        record.load = status & 0x3FF;
+        record.current = (status >> 16) & 0x1F;
+        record.flags = (status >> 31 & 1 ? STANDSTILL : 0)
+                     | (status >> 25 & 1 ? OVERTEMPERATURE : 0)
+                     | (status >> 26 & 1 ? PREWARNING : 0)
+                     | (status >> 29 & 1 ? OPEN_LOAD_A : 0)
+                     | (status >> 30 & 1 ? OPEN_LOAD_B : 0)
+                     | (status >> 24 & 1 ? STALL : 0);
+        return record;
+    }
+};
+static_assert(sizeof(TelemetryRecord) == 8, "TelemetryRecord must stay packed");
+
+struct TelemetrySummary
+{
+    uint32_t count = 0;
+    uint16_t loadMin = 0, loadMax = 0;
+    uint8_t currentMin = 0, currentMax = 0;
+    float loadMean = 0.f, currentMean = 0.f;
+    // union of the flags seen in the window
+    uint8_t flags = 0;
+};
+
+// Samples DRV_STATUS from the control task into a ring of records. The
+// control task only does the SPI read and a lock-free push, streaming and
+// summaries read the ring from other tasks.
+class TMCTelemetry
+{
+public:
+    static const int size = 256;
+    // ms between samples, 0 disables sampling
+    uint32_t period = 20;
+    SampleRing<TelemetryRecord, size> ring;
+
+    void sample(TMC5160Registers &registers, uint32_t now)
+    {
+        if (period == 0 || now - lastSample < period) return;
+        ring.push(TelemetryRecord::decode(registers.readDrvStatus(), now));
+        lastSample = now;
+    }
+
+    // Records not streamed yet, oldest first, single consumer
+    int next(TelemetryRecord *out, int n)
+    {
+        uint32_t start = cursor;
+        int count = ring.from(cursor, out, n);
+        // the cursor jumps over records the ring overwrote
+        dropped += cursor - start - count;
+        return count;
+    }
+
+    // Index of the next record to stream
+    uint32_t getCursor() {return cursor;}
+
+    // Summary of the records of the last window ms
+    TelemetrySummary summarize(uint32_t window, uint32_t now)
+    {
+        TelemetrySummary summary;
+        TelemetryRecord records[32];
+        uint32_t first = ring.size() > size - 1 ? ring.size() - (size - 1) : 0;
+        float loadSum = 0.f, currentSum = 0.f;
+        int count;
+        while ((count = ring.from(first, records, 32)) > 0) {
+            for (int i = 0; i < count; i++) {
+                TelemetryRecord &record = records[i];
+                if (now - record.time > window) continue;
+                if (summary.count == 0 || record.load < summary.loadMin) summary.loadMin = record.load;
+                if (summary.count == 0 || record.current < summary.currentMin) summary.currentMin = record.current;
+                summary.loadMax = max(summary.loadMax, record.load);
+                summary.currentMax = max(summary.currentMax, record.current);
+                summary.flags |= record.flags;
+                loadSum += record.load;
+                currentSum += record.current;
+                summary.count++;
+            }
+        }
+        if (summary.count > 0) {
+            summary.loadMean = loadSum / summary.count;
+            summary.currentMean = currentSum / summary.count;
+        }
+        return summary;
+    }
+
+    uint32_t dropped = 0;
+
+private:
+    uint32_t lastSample = 0;
+    uint32_t cursor = 0;
+};
+
+#endif
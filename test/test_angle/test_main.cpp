@@ -0,0 +1,301 @@
+#include <unity.h>
+#include <random>
+#include <angle.h>
+#include <closedloopcontroller.h>
+
+static const float resolution = 360.f / 4294967296.f;
+
+void test_degrees_round_trip()
+{
+    for (float degrees = -720.f; degrees <= 720.f; degrees += 0.37f) {
+        BinaryAngle angle = BinaryAngle::fromDegrees(degrees);
+        float wrapped = degrees - 360.f * floorf(degrees / 360.f);
+        float error = BinaryAngle{angle.value - BinaryAngle::fromDegrees(wrapped).value}.toSignedDegrees();
+        TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.f, error);
+        TEST_ASSERT_FLOAT_WITHIN(2e-4f, wrapped, angle.toDegrees() == 360.f ? 0.f : angle.toDegrees());
+    }
+}
+
+void test_wrap_is_integer_overflow()
+{
+    TEST_ASSERT_EQUAL_HEX32(0x80000000u, BinaryAngle::fromDegrees(180.f).value);
+    TEST_ASSERT_EQUAL_HEX32(0x40000000u, BinaryAngle::fromDegrees(90.f).value);
+    TEST_ASSERT_EQUAL_HEX32(0xC0000000u, BinaryAngle::fromDegrees(-90.f).value);
+    TEST_ASSERT_EQUAL_HEX32(0x40000000u, BinaryAngle::fromDegrees(450.f).value);
+    BinaryAngle sum = BinaryAngle::fromDegrees(270.f) + BinaryAngle::fromDegrees(180.f);
+    TEST_ASSERT_EQUAL_HEX32(0x40000000u, sum.value);
+    TEST_ASSERT_EQUAL_HEX32(0xC0000000u, (-BinaryAngle::fromDegrees(90.f)).value);
+    TEST_ASSERT_FLOAT_WITHIN(resolution, -180.f, BinaryAngle::fromDegrees(180.f).toSignedDegrees());
+}
+
+void test_distance_is_the_shortest_way()
+{
+    BinaryAngle a = BinaryAngle::fromDegrees(350.f);
+    BinaryAngle b = BinaryAngle::fromDegrees(10.f);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 20.f, b.distanceDegrees(a));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, -20.f, a.distanceDegrees(b));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 179.f, BinaryAngle::fromDegrees(179.f).distanceDegrees(BinaryAngle{0}));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, -179.f, BinaryAngle::fromDegrees(181.f).distanceDegrees(BinaryAngle{0}));
+    TEST_ASSERT_EQUAL_INT32(int32_t(0x80000000u), BinaryAngle::fromDegrees(180.f).distance(BinaryAngle{0}));
+}
+
+void test_sensor_readings()
+{
+    TEST_ASSERT_EQUAL_HEX32(0x80000000u, BinaryAngle::fromRaw(8192, 14).value);
+    TEST_ASSERT_EQUAL_HEX32(0x40000000u, BinaryAngle::fromCounts(1000, 4000).value);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 36.f, BinaryAngle::fromCounts(400, 4000).toDegrees());
+    BinaryAngle angle = BinaryAngle::fromDegrees(100.f);
+    // 128 bins of 2.8125°
+    TEST_ASSERT_EQUAL_UINT32(35, angle.index(7));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, (100.f - 35 * 2.8125f) / 2.8125f, angle.fraction(7));
+}
+
+// Exact degrees of a binary angle and a double reference of the wrap
+static double toDouble(BinaryAngle angle)
+{
+    return angle.value * (360. / 4294967296.);
+}
+
+static double wrapTurn(double degrees)
+{
+    return degrees - 360. * floor(degrees / 360.);
+}
+
+// Shortest signed distance from b to a in [-180, 180)
+static double referenceDistance(double a, double b)
+{
+    return wrapTurn(a - b + 180.) - 180.;
+}
+
+// Checks conversions and distances of a against b, with double references
+static void checkPair(BinaryAngle a, BinaryAngle b)
+{
+    float degrees = a.toDegrees();
+    TEST_ASSERT_TRUE(degrees >= 0.f && degrees <= 360.f);
+    TEST_ASSERT_FLOAT_WITHIN(3e-5f, toDouble(a), degrees);
+    // toDegrees() rounds up to 360 at the end of the turn
+    TEST_ASSERT_FLOAT_WITHIN(6e-5f, 0.f, BinaryAngle::fromDegrees(degrees).distanceDegrees(a));
+    float signedDegrees = a.toSignedDegrees();
+    TEST_ASSERT_TRUE(signedDegrees >= -180.f && signedDegrees <= 180.f);
+
+    int32_t forward = a.distance(b);
+    int32_t backward = b.distance(a);
+    // a half turn is -180° both ways, every other distance is antisymmetric
+    if (forward == INT32_MIN) TEST_ASSERT_EQUAL_INT32(INT32_MIN, backward);
+    else TEST_ASSERT_EQUAL_INT32(-forward, backward);
+    double reference = referenceDistance(toDouble(a), toDouble(b));
+    TEST_ASSERT_TRUE(reference >= -180. && reference < 180.);
+    TEST_ASSERT_TRUE(forward * (360. / 4294967296.) == reference);
+    TEST_ASSERT_EQUAL_HEX32(a.value, (b + forward).value);
+    float distance = a.distanceDegrees(b);
+    TEST_ASSERT_TRUE(distance >= -180.f && distance <= 180.f);
+    TEST_ASSERT_FLOAT_WITHIN(2e-5f, float(reference), distance);
+}
+
+// Every 2^12th angle of the turn against a random one, and its neighbours
+void test_stride_sweep()
+{
+    std::mt19937 random(16);
+    uint32_t count = 0;
+    for (uint64_t value = 0; value < (1ull << 32); value += 1u << 12) {
+        BinaryAngle a{uint32_t(value)};
+        checkPair(a, BinaryAngle(random()));
+        checkPair(a, a + int32_t(1));
+        checkPair(a, BinaryAngle(uint32_t(value) + 0x80000000u));
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(1u << 20, count);
+    checkPair(BinaryAngle(UINT32_MAX), BinaryAngle(0u));
+    checkPair(BinaryAngle(0x7FFFFFFFu), BinaryAngle(0x80000000u));
+}
+
+void test_random_pairs()
+{
+    std::mt19937 random(1);
+    for (int i = 0; i < 1000000; i++) checkPair(BinaryAngle(random()), BinaryAngle(random()));
+}
+
+// Degrees in, degrees out, over several turns either way
+void test_random_degrees_round_trip()
+{
+    std::mt19937 random(2);
+    std::uniform_real_distribution<float> anyDegrees(-720.f, 720.f);
+    for (int i = 0; i < 1000000; i++) {
+        float input = anyDegrees(random);
+        BinaryAngle angle = BinaryAngle::fromDegrees(input);
+        TEST_ASSERT_FLOAT_WITHIN(1e-4, 0., referenceDistance(toDouble(angle), input));
+        TEST_ASSERT_FLOAT_WITHIN(1e-4, 0., referenceDistance(angle.toDegrees(), input));
+    }
+}
+
+// Double reference of AxisPath::plan(), the same rules on wrapped degrees
+static void checkPath(BinaryAngle position, BinaryAngle target, BinaryAngle limitA, BinaryAngle limitB)
+{
+    double start = wrapTurn(toDouble(position) - toDouble(limitA));
+    double end = wrapTurn(toDouble(target) - toDouble(limitA));
+    double span = wrapTurn(toDouble(limitB) - toDouble(limitA));
+    bool clamped = end > span;
+    if (clamped) end = end - span <= 360. - end ? span : 0.;
+    bool escaping = start > span;
+    double travel = end - start;
+    if (escaping && start - span > 360. - start) travel = 360. - start + end;
+
+    AxisPath path = AxisPath::plan(position, target, limitA, limitB);
+    TEST_ASSERT_EQUAL(clamped, path.clamped);
+    TEST_ASSERT_EQUAL(escaping, path.escaping);
+    TEST_ASSERT_TRUE(path.travel * (360. / 4294967296.) == travel);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, float(travel), path.getTravel());
+    // the move never enters the forbidden arc
+    if (!escaping) {
+        double stop = start + travel;
+        TEST_ASSERT_TRUE(stop >= 0. && stop <= span);
+    }
+}
+
+// Limits, positions and targets around the 0/360 seam against the reference
+void test_limits_across_the_seam()
+{
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> nearSeam(-30.f, 30.f);
+    std::uniform_real_distribution<float> anywhere(0.f, 360.f);
+    for (int i = 0; i < 200000; i++) {
+        float a = nearSeam(random);
+        float b = nearSeam(random);
+        if (a == b) continue;
+        // allowed arc across the seam on even pairs, forbidden arc on odd
+        if ((i & 1) == (a < b)) std::swap(a, b);
+        BinaryAngle limitA = BinaryAngle::fromDegrees(a);
+        BinaryAngle limitB = BinaryAngle::fromDegrees(b);
+        BinaryAngle position = BinaryAngle::fromDegrees(i & 2 ? nearSeam(random) : anywhere(random));
+        BinaryAngle target = BinaryAngle::fromDegrees(i & 4 ? nearSeam(random) : anywhere(random));
+        checkPath(position, target, limitA, limitB);
+        checkPath(BinaryAngle(0u), target, limitA, limitB);
+        checkPath(position, BinaryAngle(UINT32_MAX), limitA, limitB);
+        checkPath(limitA, limitB, limitA, limitB);
+        checkPath(limitB, limitA, limitA, limitB);
+    }
+}
+
+// Encoder that reads a fixed angle
+class FixedEncoder : public Encoder
+{
+public:
+    float degrees = 0.f;
+    FixedEncoder() : Encoder(1 << 14) {}
+    int readEncoder() override {
+        return int(lroundf(degrees / 360.f * 16384.f)) & 16383;
+    }
+};
+
+// One axis with a stepper stand-in and a fixed encoder
+struct Axis
+{
+    TMC5160Stepper driver {10, R_SENSE, 13, 11, 12};
+    FastAccelStepperEngine engine;
+    TMC5160Controller stepper {driver, engine, 9, 8};
+    FixedEncoder encoder;
+    ClosedLoopController controller {stepper, encoder};
+
+    Axis() {
+        stepper.init();
+        encoder.maxRate = 1e9f;
+    }
+    // Error seen from position towards target, with the given limits
+    float error(float position, float target) {
+        encoder.degrees = position;
+        advanceMicros(30000);
+        controller.targetAngle = BinaryAngle::fromDegrees(target);
+        TEST_ASSERT_TRUE(controller.updateError());
+        return controller.error;
+    }
+    void setLimits(float a, float b) {
+        controller.hasLimits = true;
+        controller.limitA = BinaryAngle::fromDegrees(a);
+        controller.limitB = BinaryAngle::fromDegrees(b);
+    }
+};
+
+static const float quantum = 360.f / 16384.f;
+
+void test_no_limits_takes_the_shortest_way()
+{
+    Axis axis;
+    TEST_ASSERT_FLOAT_WITHIN(quantum, 20.f, axis.error(350.f, 10.f));
+    TEST_ASSERT_FLOAT_WITHIN(quantum, -20.f, axis.error(10.f, 350.f));
+    TEST_ASSERT_FLOAT_WITHIN(quantum, 170.f, axis.error(0.f, 170.f));
+    TEST_ASSERT_FLOAT_WITHIN(quantum, -170.f, axis.error(0.f, 190.f));
+}
+
+// Equal limits mean a full turn, the axis is not constrained
+void test_equal_limits_are_a_full_turn()
+{
+    Axis axis;
+    axis.setLimits(90.f, 90.f);
+    TEST_ASSERT_FLOAT_WITHIN(quantum, 20.f, axis.error(80.f, 100.f));
+    TEST_ASSERT_FLOAT_WITHIN(quantum, 20.f, axis.error(350.f, 10.f));
+    TEST_ASSERT_FLOAT_WITHIN(quantum, -20.f, axis.error(10.f, 350.f));
+    TEST_ASSERT_FALSE(axis.controller.path.clamped);
+}
+
+// Allowed arc from 350° to 10° across 0°
+void test_allowed_arc_across_zero()
+{
+    Axis axis;
+    axis.setLimits(350.f, 10.f);
+    TEST_ASSERT_FLOAT_WITHIN(quantum, 10.f, axis.error(355.f, 5.f));
+    TEST_ASSERT_FLOAT_WITHIN(quantum, -10.f, axis.error(5.f, 355.f));
+    TEST_ASSERT_FALSE(axis.controller.path.clamped);
+}
+
+// Allowed arc from 10° to 350°, the forbidden one across 0° is never crossed
+void test_forbidden_arc_across_zero()
+{
+    Axis axis;
+    axis.setLimits(10.f, 350.f);
+    TEST_ASSERT_FLOAT_WITHIN(quantum, 320.f, axis.error(20.f, 340.f));
+    TEST_ASSERT_FLOAT_WITHIN(quantum, -320.f, axis.error(340.f, 20.f));
+}
+
+// Targets in the forbidden arc are clamped to the nearest limit
+void test_target_clamped_to_nearest_limit()
+{
+    Axis axis;
+    axis.setLimits(10.f, 350.f);
+    TEST_ASSERT_FLOAT_WITHIN(quantum, -10.f, axis.error(20.f, 2.f));
+    TEST_ASSERT_TRUE(axis.controller.path.clamped);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 10.f, axis.controller.targetAngle.toDegrees());
+    TEST_ASSERT_FLOAT_WITHIN(quantum, 10.f, axis.error(340.f, 358.f));
+    TEST_ASSERT_TRUE(axis.controller.path.clamped);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 350.f, axis.controller.targetAngle.toDegrees());
+}
+
+// An axis past a limit goes back across it, not through the forbidden arc
+void test_overrun_goes_back_across_the_limit()
+{
+    Axis axis;
+    axis.setLimits(10.f, 350.f);
+    TEST_ASSERT_FLOAT_WITHIN(quantum, 15.f, axis.error(5.f, 20.f));
+    TEST_ASSERT_TRUE(axis.controller.path.escaping);
+    TEST_ASSERT_FLOAT_WITHIN(quantum, -15.f, axis.error(355.f, 340.f));
+    TEST_ASSERT_FLOAT_WITHIN(quantum, 335.f, axis.error(5.f, 340.f));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_degrees_round_trip);
+    RUN_TEST(test_wrap_is_integer_overflow);
+    RUN_TEST(test_distance_is_the_shortest_way);
+    RUN_TEST(test_sensor_readings);
+    RUN_TEST(test_stride_sweep);
+    RUN_TEST(test_random_pairs);
+    RUN_TEST(test_random_degrees_round_trip);
+    RUN_TEST(test_limits_across_the_seam);
+    RUN_TEST(test_no_limits_takes_the_shortest_way);
+    RUN_TEST(test_equal_limits_are_a_full_turn);
+    RUN_TEST(test_allowed_arc_across_zero);
+    RUN_TEST(test_forbidden_arc_across_zero);
+    RUN_TEST(test_target_clamped_to_nearest_limit);
+    RUN_TEST(test_overrun_goes_back_across_the_limit);
+    return UNITY_END();
+}
@@ -0,0 +1,127 @@
+#include <unity.h>
+#include <chrono>
+#include <random>
+#include <closedloopcontroller.h>
+
+static double elapsedNanos(std::chrono::steady_clock::time_point start, size_t n)
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n;
+}
+
+// Encoder that never reads, the lookups take raw angles
+class IdleEncoder : public Encoder
+{
+public:
+    IdleEncoder() : Encoder(1 << 14) {}
+    int readEncoder() override {return -1;}
+};
+
+struct Axis
+{
+    TMC5160Stepper driver {10, R_SENSE, 13, 11, 12};
+    FastAccelStepperEngine engine;
+    TMC5160Controller stepper {driver, engine, 9, 8};
+    IdleEncoder encoder;
+    ClosedLoopController controller {stepper, encoder};
+};
+
+// Magnet eccentricity and a third harmonic, in degrees
+static float encoderError(float degrees)
+{
+    float theta = degToRad(degrees);
+    return 0.3f + 0.4f * sinf(theta) - 0.2f * cosf(theta) + 0.05f * cosf(3.f * theta);
+}
+
+// Table and series filled with the same error, as calibration would
+static void fill(ClosedLoopController &controller, int steps)
+{
+    TEST_ASSERT_TRUE(controller.setCalibrationSteps(steps));
+    for (int i = 0; i < steps; i++) {
+        controller.calibrationOffsets[i] = ClosedLoopController::toFixedOffset(encoderError(360.f * i / steps));
+        controller.calibrationFilled[i] = true;
+    }
+    float fourier[] = {0.3f, -0.2f, 0.4f, 0.f, 0.f, 0.05f, 0.f, 0.f, 0.f};
+    std::copy(std::begin(fourier), std::end(fourier), controller.calibrationFourier);
+}
+
+// Both lookups follow the error, the table within its interpolation and
+// fixed point rounding
+void test_lookup_accuracy()
+{
+    Axis axis;
+    ClosedLoopController &controller = axis.controller;
+    for (int steps : {32, 128, 1024}) {
+        fill(controller, steps);
+        float tableMax = 0.f, fourierMax = 0.f;
+        for (uint32_t raw = 0; raw < 16384; raw++) {
+            BinaryAngle angle = BinaryAngle::fromRaw(raw, 14);
+            float expected = encoderError(angle.toDegrees());
+            controller.calibrationMode = CalibrationMode::TABLE;
+            tableMax = max(tableMax, abs(controller.getCalibrationOffset(angle) - expected));
+            controller.calibrationMode = CalibrationMode::FOURIER;
+            fourierMax = max(fourierMax, abs(controller.getCalibrationOffset(angle) - expected));
+        }
+        // second derivative below 1 °/rad², h² / 8 with h the bin width
+        float binWidth = 2.f * float(pi) / steps;
+        TEST_ASSERT_LESS_THAN_FLOAT(binWidth * binWidth / 8.f + ClosedLoopController::calibrationScale, tableMax);
+        TEST_ASSERT_LESS_THAN_FLOAT(1e-4f, fourierMax);
+    }
+}
+
+// A measured zero offset is kept as a measurement
+void test_zero_offset_is_a_value()
+{
+    Axis axis;
+    ClosedLoopController &controller = axis.controller;
+    controller.setCalibrationSteps(64);
+    TEST_ASSERT_FALSE(controller.calibrationFilled[5]);
+    controller.calibrationOffsets[5] = 0;
+    controller.calibrationFilled[5] = true;
+    controller.resetCalibration();
+    TEST_ASSERT_EQUAL_INT(64, controller.calibrationSteps);
+    TEST_ASSERT_FALSE(controller.calibrationFilled[5]);
+    // resizing clears the bins in place
+    controller.calibrationFilled[5] = true;
+    controller.setCalibrationSteps(128);
+    TEST_ASSERT_FALSE(controller.calibrationFilled.any());
+}
+
+// getCalibrationOffset() per encoder read, table against Fourier series
+void test_lookup_benchmark()
+{
+    Axis axis;
+    ClosedLoopController &controller = axis.controller;
+    const size_t n = 1 << 20;
+    std::vector<BinaryAngle> angles(n);
+    std::mt19937 random(1);
+    for (BinaryAngle &angle : angles) angle = BinaryAngle(random());
+    for (int steps : {128, 1024}) {
+        fill(controller, steps);
+        volatile float sink = 0.f;
+
+        controller.calibrationMode = CalibrationMode::TABLE;
+        auto start = std::chrono::steady_clock::now();
+        for (BinaryAngle angle : angles) sink = sink + controller.getCalibrationOffset(angle);
+        double table = elapsedNanos(start, n);
+
+        controller.calibrationMode = CalibrationMode::FOURIER;
+        start = std::chrono::steady_clock::now();
+        for (BinaryAngle angle : angles) sink = sink + controller.getCalibrationOffset(angle);
+        double fourier = elapsedNanos(start, n);
+
+        char message[120];
+        snprintf(message, sizeof(message), "%d bins : table %.1f ns, Fourier (%d harmonics) %.1f ns per lookup, %zu bytes",
+                 steps, table, ClosedLoopController::calibrationHarmonics, fourier, steps * sizeof(int16_t));
+        TEST_MESSAGE(message);
+        TEST_ASSERT_LESS_THAN_DOUBLE(fourier, table);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_lookup_accuracy);
+    RUN_TEST(test_zero_offset_is_a_value);
+    RUN_TEST(test_lookup_benchmark);
+    return UNITY_END();
+}
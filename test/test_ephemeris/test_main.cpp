@@ -0,0 +1,123 @@
+#include <unity.h>
+#include <chrono>
+#include <sun.h>
+
+// Paris, on the summer solstice and around the equinox
+static const double latitude = 48.85;
+static const double longitude = 2.35;
+static const time_t solstice = 1718928000;
+static const time_t equinox = 1710892800;
+
+static double elapsedNanos(std::chrono::steady_clock::time_point start, int n)
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n;
+}
+
+static float angularError(double a, double b)
+{
+    double d = fmod(a - b + 540., 360.) - 180.;
+    return abs(d);
+}
+
+void test_miss_is_computed_directly_and_queued()
+{
+    SolarEphemeris ephemeris;
+    SphericalCoordinate direct = computeSolarPosition(latitude, longitude, solstice + 43200);
+    SphericalCoordinate position = ephemeris.getPosition(latitude, longitude, solstice + 43200);
+    TEST_ASSERT_EQUAL_UINT32(1, ephemeris.getMisses());
+    TEST_ASSERT_EQUAL_UINT32(0, ephemeris.getBuildCount());
+    TEST_ASSERT_EQUAL_FLOAT(direct.azimuth, position.azimuth);
+    TEST_ASSERT_EQUAL_FLOAT(direct.elevation, position.elevation);
+    TEST_ASSERT_TRUE(ephemeris.update());
+    TEST_ASSERT_FALSE(ephemeris.update());
+    ephemeris.getPosition(latitude, longitude, solstice + 43260);
+    TEST_ASSERT_EQUAL_UINT32(1, ephemeris.getMisses());
+    TEST_ASSERT_EQUAL_UINT32(1, ephemeris.getBuildCount());
+}
+
+void test_interpolation_error()
+{
+    for (time_t day : {solstice, equinox}) {
+        SolarEphemeris ephemeris;
+        ephemeris.getPosition(latitude, longitude, day);
+        ephemeris.update();
+        float azimuthMax = 0.f, elevationMax = 0.f;
+        for (time_t t = day; t < day + SECS_PER_DAY - SolarEphemeris::prefetch; t += 37) {
+            SphericalCoordinate direct = computeSolarPosition(latitude, longitude, t);
+            SphericalCoordinate table = ephemeris.getPosition(latitude, longitude, t);
+            elevationMax = max(elevationMax, angularError(table.elevation, direct.elevation));
+            if (direct.elevation > 0.) azimuthMax = max(azimuthMax, angularError(table.azimuth, direct.azimuth));
+        }
+        TEST_ASSERT_EQUAL_UINT32(1, ephemeris.getMisses());
+        // the direct values carry the float rounding of SolarPosition too
+        TEST_ASSERT_LESS_THAN_FLOAT(0.02f, elevationMax);
+        TEST_ASSERT_LESS_THAN_FLOAT(0.05f, azimuthMax);
+    }
+}
+
+// The next day is queued ahead of midnight and built into the second table,
+// the current one keeps answering meanwhile
+void test_next_day_is_prefetched()
+{
+    SolarEphemeris ephemeris;
+    ephemeris.getPosition(latitude, longitude, solstice);
+    ephemeris.update();
+    ephemeris.getPosition(latitude, longitude, solstice + SECS_PER_DAY - 600);
+    TEST_ASSERT_TRUE(ephemeris.update());
+    ephemeris.getPosition(latitude, longitude, solstice + SECS_PER_DAY - 1);
+    ephemeris.getPosition(latitude, longitude, solstice + SECS_PER_DAY + 1);
+    TEST_ASSERT_EQUAL_UINT32(1, ephemeris.getMisses());
+    TEST_ASSERT_EQUAL_UINT32(2, ephemeris.getBuildCount());
+}
+
+// Two sites queried in turn keep one table each
+void test_two_sites_do_not_rebuild()
+{
+    SolarEphemeris ephemeris;
+    ephemeris.getPosition(latitude, longitude, solstice);
+    ephemeris.update();
+    ephemeris.getPosition(latitude + 1., longitude, solstice);
+    ephemeris.update();
+    for (int i = 0; i < 10; i++) {
+        ephemeris.getPosition(latitude, longitude, solstice + i);
+        ephemeris.getPosition(latitude + 1., longitude, solstice + i);
+    }
+    TEST_ASSERT_EQUAL_UINT32(2, ephemeris.getBuildCount());
+    TEST_ASSERT_EQUAL_UINT32(2, ephemeris.getMisses());
+}
+
+void test_benchmark()
+{
+    const int n = 100000;
+    SolarEphemeris ephemeris;
+    ephemeris.getPosition(latitude, longitude, solstice);
+    auto start = std::chrono::steady_clock::now();
+    ephemeris.update();
+    double build = elapsedNanos(start, 1);
+
+    volatile double sink = 0.;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) sink = sink + ephemeris.getPosition(latitude, longitude, solstice + i * 0.5).elevation;
+    double lookup = elapsedNanos(start, n);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) sink = sink + computeSolarPosition(latitude, longitude, solstice + i / 2).elevation;
+    double direct = elapsedNanos(start, n);
+
+    char message[160];
+    snprintf(message, sizeof(message), "build %.0f us, lookup %.0f ns, direct %.0f ns, lookup speedup %.1fx",
+             build / 1000., lookup, direct, direct / lookup);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_THAN_DOUBLE(direct, lookup);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_miss_is_computed_directly_and_queued);
+    RUN_TEST(test_interpolation_error);
+    RUN_TEST(test_next_day_is_prefetched);
+    RUN_TEST(test_two_sites_do_not_rebuild);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,272 @@
+#include <unity.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <field.h>
+
+static double elapsedNanos(std::chrono::steady_clock::time_point start, size_t n)
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n;
+}
+
+static double separation(vec2 a, vec2 b)
+{
+    vec3 u = toCartesian(a);
+    vec3 v = toCartesian(b);
+    return radToDeg(std::atan2(u.cross(v).length(), u.dot(v)));
+}
+
+// Mirrors on a square grid with some height jitter, north of a tower
+static void fillField(HeliostatField &field, size_t n, float spacing = 6.f)
+{
+    int side = int(std::ceil(std::sqrt(double(n))));
+    vec3f tower = {0.f, 0.f, 60.f};
+    for (size_t i = 0; i < n; i++) {
+        float x = (int(i % side) - side / 2) * spacing;
+        float y = 20.f + int(i / side) * spacing;
+        float z = 1.5f + 0.1f * float(i % 7);
+        field.add(vec3f{x, y, z}, tower);
+    }
+}
+
+// The kernel gives the angles of reflectDirection() for each mirror
+void test_reflect_matches_scalar_path()
+{
+    HeliostatField field;
+    fillField(field, 400);
+    MountOrientationT<double> level;
+    for (vec2 sun : {vec2{90., 60.}, vec2{150., 20.}, vec2{270., 85.}, vec2{10., 0.5}}) {
+        field.reflect(SphericalCoordinate{sun.x, sun.y});
+        double maxError = 0.;
+        for (size_t i = 0; i < field.size(); i++) {
+            vec3 toTarget = {double(field.targetX[i] - field.x[i]), double(field.targetY[i] - field.y[i]), double(field.targetZ[i] - field.z[i])};
+            vec2 expected = reflectDirection(sun, toSpherical(toTarget), level);
+            SphericalCoordinate angles = field.getAngles(i);
+            maxError = max(maxError, separation(expected, vec2{angles.azimuth, angles.elevation}));
+        }
+        TEST_ASSERT_LESS_THAN_DOUBLE(1e-3, maxError);
+    }
+}
+
+void test_reflect_degenerate_mirrors_stay_finite()
+{
+    HeliostatField field;
+    // at its target
+    field.add(vec3f{1.f, 2.f, 3.f}, vec3f{1.f, 2.f, 3.f});
+    // the sun right behind the target
+    field.add(vec3f{0.f, 0.f, 0.f}, vec3f{0.f, 0.f, -10.f});
+    vec3f sun = {0.f, 0.f, 1.f};
+    field.reflect(sun);
+    for (size_t i = 0; i < field.size(); i++) {
+        TEST_ASSERT_FLOAT_IS_DETERMINATE(field.normalX[i]);
+        TEST_ASSERT_FLOAT_IS_DETERMINATE(field.normalY[i]);
+        TEST_ASSERT_FLOAT_IS_DETERMINATE(field.normalZ[i]);
+        TEST_ASSERT_FLOAT_IS_DETERMINATE(field.azimuth[i]);
+        TEST_ASSERT_FLOAT_IS_DETERMINATE(field.elevation[i]);
+    }
+    TEST_ASSERT_EQUAL_FLOAT(1.f, field.normalZ[0]);
+    TEST_ASSERT_EQUAL_FLOAT(0.f, field.normalZ[1]);
+}
+
+// Structure of arrays kernel against one reflectDirection() per mirror, as
+// HeliostatController does it
+void test_reflect_benchmark()
+{
+    vec2f sun = {150.f, 40.f};
+    MountOrientation level;
+    for (size_t n : {1000, 10000, 100000}) {
+        HeliostatField field;
+        fillField(field, n);
+        const int runs = n < 100000 ? 100 : 10;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < runs; r++) field.reflect(toCartesian(sun));
+        double kernel = elapsedNanos(start, n * runs);
+
+        std::vector<vec2f> angles(n);
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < runs; r++) {
+            for (size_t i = 0; i < n; i++) {
+                vec3f toTarget = {field.targetX[i] - field.x[i], field.targetY[i] - field.y[i], field.targetZ[i] - field.z[i]};
+                angles[i] = reflectDirection(sun, toSpherical(toTarget), level);
+            }
+        }
+        double scalar = elapsedNanos(start, n * runs);
+
+        char message[120];
+        snprintf(message, sizeof(message), "%zu mirrors : kernel %.1f ns, scalar %.1f ns per mirror, %.1fx",
+                 n, kernel, scalar, scalar / kernel);
+        TEST_MESSAGE(message);
+        TEST_ASSERT_LESS_THAN_DOUBLE(scalar, kernel);
+    }
+}
+
+// Mirrors scattered at random around a target, a tower by default, packed
+// enough to shade and block each other with a low sun
+static void fillRandomField(HeliostatField &field, size_t n, uint32_t seed, vec3f target = {0.f, 0.f, 40.f})
+{
+    std::mt19937 random(seed);
+    float extent = 4.f * std::sqrt(float(n));
+    std::uniform_real_distribution<float> position(-extent, extent);
+    std::uniform_real_distribution<float> height(1.f, 2.5f);
+    while (field.size() < n) {
+        vec3f mirror = {position(random), position(random), height(random)};
+        if (mirror.x * mirror.x + mirror.y * mirror.y > 100.f) field.add(mirror, target);
+    }
+}
+
+// Same mirror rectangle and samples as HeliostatField::computeShading()
+static void mirrorAxes(HeliostatField &field, size_t i, vec3f &u, vec3f &v)
+{
+    vec3f normal = {field.normalX[i], field.normalY[i], field.normalZ[i]};
+    float horizontal = sqrtf(normal.x * normal.x + normal.y * normal.y);
+    u = horizontal > 1e-6f ? vec3f{-normal.y / horizontal, normal.x / horizontal, 0.f} : vec3f{1.f, 0.f, 0.f};
+    v = normal.cross(u);
+}
+
+static bool hitsMirror(HeliostatField &field, size_t j, vec3f origin, vec3f direction, float range)
+{
+    vec3f normal = {field.normalX[j], field.normalY[j], field.normalZ[j]};
+    float denom = direction.dot(normal);
+    if (abs(denom) < 1e-6f) return false;
+    vec3f center = {field.x[j], field.y[j], field.z[j]};
+    float t = (center - origin).dot(normal) / denom;
+    if (t <= 1e-4f || t > range) return false;
+    vec3f hit = origin + direction * t - center;
+    vec3f u, v;
+    mirrorAxes(field, j, u, v);
+    return abs(hit.dot(u)) <= 0.5f * field.mirrorWidth && abs(hit.dot(v)) <= 0.5f * field.mirrorHeight;
+}
+
+static bool hitsAnyMirror(HeliostatField &field, size_t self, vec3f origin, vec3f direction, float range = INFINITY)
+{
+    for (size_t j = 0; j < field.size(); j++) {
+        if (j != self && hitsMirror(field, j, origin, direction, range)) return true;
+    }
+    return false;
+}
+
+// O(N²) reference : every sample ray against every other mirror. Blocking
+// counts mirrors up to the target, or along the whole ray when unbounded.
+static void bruteForceShading(HeliostatField &field, vec3f sun, std::vector<float> &shading, std::vector<float> &blocking, bool unbounded = false)
+{
+    sun = sun.normalize();
+    int samples = field.shadingSamples;
+    shading.assign(field.size(), 0.f);
+    blocking.assign(field.size(), 0.f);
+    for (size_t i = 0; i < field.size(); i++) {
+        vec3f center = {field.x[i], field.y[i], field.z[i]};
+        vec3f target = {field.targetX[i], field.targetY[i], field.targetZ[i]};
+        vec3f u, v;
+        mirrorAxes(field, i, u, v);
+        for (int a = 0; a < samples; a++) {
+            for (int b = 0; b < samples; b++) {
+                float du = field.mirrorWidth * ((a + 0.5f) / samples - 0.5f);
+                float dv = field.mirrorHeight * ((b + 0.5f) / samples - 0.5f);
+                vec3f point = center + u * du + v * dv;
+                if (hitsAnyMirror(field, i, point, sun)) shading[i] += 1.f / (samples * samples);
+                else {
+                    vec3f toTarget = target - point;
+                    float distance = toTarget.length();
+                    if (hitsAnyMirror(field, i, point, toTarget / distance, unbounded ? INFINITY : distance)) blocking[i] += 1.f / (samples * samples);
+                }
+            }
+        }
+    }
+}
+
+// The grid traversal finds the same shaded and blocked samples as the
+// pairwise check
+void test_shading_matches_brute_force()
+{
+    for (uint32_t seed : {1u, 2u, 3u}) {
+        HeliostatField field;
+        fillRandomField(field, 150, seed);
+        for (vec2f sunAngles : {vec2f{100.f, 75.f}, vec2f{200.f, 60.f}, vec2f{300.f, 80.f}}) {
+            vec3f sun = toCartesian(sunAngles);
+            field.reflect(sun);
+            field.buildGrid();
+            field.computeShading(sun);
+            std::vector<float> shading, blocking;
+            bruteForceShading(field, sun, shading, blocking);
+            float shaded = 0.f, blocked = 0.f;
+            for (size_t i = 0; i < field.size(); i++) {
+                TEST_ASSERT_EQUAL_FLOAT(shading[i], field.shading[i]);
+                TEST_ASSERT_EQUAL_FLOAT(blocking[i], field.blocking[i]);
+                shaded += shading[i];
+                blocked += blocking[i];
+            }
+            // the field is dense enough for both to happen
+            TEST_ASSERT_GREATER_THAN(0, int(shaded * 16.f));
+            TEST_ASSERT_GREATER_THAN(0, int(blocked * 16.f));
+        }
+    }
+}
+
+// A target inside the field at mirror height : mirrors past the target on
+// the same line of sight must not count as blocking
+void test_blocking_stops_at_the_target()
+{
+    vec3f target = {0.f, 0.f, 1.8f};
+    for (uint32_t seed : {4u, 5u}) {
+        HeliostatField field;
+        fillRandomField(field, 150, seed, target);
+        vec3f sun = toCartesian(vec2f{160.f, 70.f});
+        field.reflect(sun);
+        field.buildGrid();
+        field.computeShading(sun);
+        std::vector<float> shading, blocking, unboundedShading, unboundedBlocking;
+        bruteForceShading(field, sun, shading, blocking);
+        bruteForceShading(field, sun, unboundedShading, unboundedBlocking, true);
+        float blocked = 0.f, unboundedBlocked = 0.f;
+        for (size_t i = 0; i < field.size(); i++) {
+            TEST_ASSERT_EQUAL_FLOAT(shading[i], field.shading[i]);
+            TEST_ASSERT_EQUAL_FLOAT(blocking[i], field.blocking[i]);
+            blocked += blocking[i];
+            unboundedBlocked += unboundedBlocking[i];
+        }
+        // the mirrors across the target would have blocked otherwise
+        TEST_ASSERT_GREATER_THAN(int(blocked * 16.f), int(unboundedBlocked * 16.f));
+    }
+}
+
+void test_shading_benchmark()
+{
+    vec3f sun = toCartesian(vec2f{150.f, 60.f});
+    for (size_t n : {100, 1000}) {
+        HeliostatField field;
+        fillRandomField(field, n, 7);
+        field.reflect(sun);
+        const int runs = n < 1000 ? 20 : 2;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < runs; r++) {
+            field.buildGrid();
+            field.computeShading(sun);
+        }
+        double grid = elapsedNanos(start, n * runs);
+
+        std::vector<float> shading, blocking;
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < runs; r++) bruteForceShading(field, sun, shading, blocking);
+        double bruteForce = elapsedNanos(start, n * runs);
+
+        char message[120];
+        snprintf(message, sizeof(message), "%zu mirrors : grid %.1f us, brute force %.1f us per mirror, %.1fx",
+                 n, grid * 1e-3, bruteForce * 1e-3, bruteForce / grid);
+        TEST_MESSAGE(message);
+        TEST_ASSERT_LESS_THAN_DOUBLE(bruteForce, grid);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_reflect_matches_scalar_path);
+    RUN_TEST(test_reflect_degenerate_mirrors_stay_finite);
+    RUN_TEST(test_reflect_benchmark);
+    RUN_TEST(test_shading_matches_brute_force);
+    RUN_TEST(test_blocking_stops_at_the_target);
+    RUN_TEST(test_shading_benchmark);
+    return UNITY_END();
+}
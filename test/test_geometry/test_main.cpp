@@ -0,0 +1,85 @@
+#include <unity.h>
+#include <geometry.h>
+#include <vector>
+
+// Default ClosedLoopController tolerance
+static const double pointingTolerance = 0.1;
+
+// Angle in degrees between two (azimuth, polar angle) directions, in double
+// so it does not add its own rounding
+static double separation(vec2 a, vec2 b)
+{
+    vec3 u = toCartesian(a);
+    vec3 v = toCartesian(b);
+    return radToDeg(std::atan2(u.cross(v).length(), u.dot(v)));
+}
+
+struct Sweep
+{
+    double maxError = 0.;
+    double maxErrorOpposite = 0.;
+    int count = 0;
+};
+
+// Sources over the whole sky against a target, float against double
+static Sweep sweep(vec2 target, double tilt, double tiltDirection, double yaw)
+{
+    Sweep result;
+    MountOrientationT<double> mount;
+    MountOrientationT<float> mountf;
+    mount.set(tilt, tiltDirection, yaw);
+    mountf.set(tilt, tiltDirection, yaw);
+    vec3 targetVector = toCartesian(target);
+    std::vector<vec2> sources;
+    for (double azimuth = 0.; azimuth < 360.; azimuth += 3.7) {
+        for (double polar = 0.; polar <= 100.; polar += 1.3) sources.push_back({azimuth, polar});
+    }
+    // and a ring of sources nearly opposite the target
+    vec2 opposite = {target.x + 180., 180. - target.y};
+    for (double offset : {0.6, 1., 2., 5.}) {
+        for (double angle = 0.; angle < 360.; angle += 15.) {
+            sources.push_back({opposite.x + offset * std::cos(degToRad(angle)), opposite.y + offset * std::sin(degToRad(angle))});
+        }
+    }
+    for (vec2 source : sources) {
+        // the bisector vanishes for opposite directions, the mirror
+        // orientation is undefined there
+        vec3 bisector = toCartesian(source) + targetVector;
+        if (bisector.length() < 1e-2) continue;
+        vec2 exact = reflectDirection(source, target, mount);
+        vec2f approx = reflectDirection(vec2f{float(source.x), float(source.y)}, vec2f{float(target.x), float(target.y)}, mountf);
+        double error = separation(exact, vec2{approx.x, approx.y});
+        if (bisector.length() < 0.1) result.maxErrorOpposite = max(result.maxErrorOpposite, error);
+        else result.maxError = max(result.maxError, error);
+        result.count++;
+    }
+    return result;
+}
+
+void test_level_mount()
+{
+    for (vec2 target : {vec2{120., 45.}, vec2{0., 0.}, vec2{200., 89.}, vec2{330., 95.}}) {
+        Sweep result = sweep(target, 0., 0., 0.);
+        TEST_ASSERT_GREATER_THAN(1000, result.count);
+        TEST_ASSERT_LESS_THAN_DOUBLE(1e-3, result.maxError);
+        TEST_ASSERT_LESS_THAN_DOUBLE(pointingTolerance, result.maxErrorOpposite);
+    }
+}
+
+void test_tilted_mount()
+{
+    Sweep result = sweep(vec2{120., 45.}, 12., 75., -30.);
+    char message[120];
+    snprintf(message, sizeof(message), "max error %.2e deg, %.2e deg with a short bisector", result.maxError, result.maxErrorOpposite);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_THAN_DOUBLE(1e-3, result.maxError);
+    TEST_ASSERT_LESS_THAN_DOUBLE(pointingTolerance, result.maxErrorOpposite);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_level_mount);
+    RUN_TEST(test_tilted_mount);
+    return UNITY_END();
+}
@@ -0,0 +1,166 @@
+#include <unity.h>
+#include <chrono>
+#include <heliostat.h>
+
+// Paris, from 8:00 UTC on the summer solstice
+static const double latitude = 48.85;
+static const double longitude = 2.35;
+static const time_t start = 1718928000 + 8 * 3600;
+static const uint32_t tickMicros = 10000;
+
+// Encoder that reads the simulated shaft of one axis, the plant is the
+// FastAccelStepper stand-in
+class ShaftEncoder : public Encoder
+{
+public:
+    TMC5160Controller &stepper;
+    ShaftEncoder(TMC5160Controller &stepper) : Encoder(1 << 14), stepper(stepper) {}
+    int readEncoder() override {
+        return int(floor(getShaftAngle() / 360. * 16384.)) & 16383;
+    }
+    double getShaftAngle() {
+        double steps = stepper.stepper->getExactPosition();
+        double turn = double(stepper.stepsPerRotation) * stepper.microsteps;
+        return 360. * (steps / turn - floor(steps / turn));
+    }
+};
+
+// One heliostat on two simulated axes, aiming the sun at a fixed target
+struct Mirror
+{
+    TMC5160Stepper azimuthDriver {10, R_SENSE, 13, 11, 12};
+    TMC5160Stepper elevationDriver {7, R_SENSE, 13, 11, 12};
+    FastAccelStepperEngine engine;
+    TMC5160Controller azimuthStepper {azimuthDriver, engine, 9, 8};
+    TMC5160Controller elevationStepper {elevationDriver, engine, 6, 5};
+    ShaftEncoder azimuthEncoder {azimuthStepper};
+    ShaftEncoder elevationEncoder {elevationStepper};
+    ClosedLoopController azimuth {azimuthStepper, azimuthEncoder};
+    ClosedLoopController elevation {elevationStepper, elevationEncoder};
+    SerialGPS gps {Serial1, RX, TX};
+    SolarEphemeris ephemeris;
+    HeliostatController heliostat {azimuth, elevation, gps, ephemeris};
+
+    Mirror(bool feedForward) {
+        setTime(start);
+        azimuthStepper.init();
+        elevationStepper.init();
+        azimuth.enabled = true;
+        elevation.enabled = true;
+        heliostat.latitude = latitude;
+        heliostat.longitude = longitude;
+        heliostat.feedForward = feedForward;
+        heliostat.targetsMap.insert({"Target", {10., 80.}});
+        heliostat.currentTarget = "Target";
+        heliostat.init();
+    }
+};
+
+struct TrackingResult
+{
+    uint32_t ticks = 0;
+    double tickNanos = 0.;
+    double tickMaxNanos = 0.;
+    float azimuthMax = 0.f;
+    float elevationMax = 0.f;
+    double azimuthSumSq = 0.;
+    double elevationSumSq = 0.;
+    uint32_t samples = 0;
+    uint32_t commands = 0;
+    uint32_t slips = 0;
+    uint32_t encoderReads = 0;
+    // reader copy of the estimated angle against the shaft
+    float cachedMax = 0.f;
+    double speedup = 0.;
+};
+
+// Runs the control loop at 100 Hz in simulated time. The plant is brought
+// up to the tick before run() is timed, so the cost is the controller's.
+// The tracking error is the shaft against the ideal reflection, once per
+// simulated second after the initial slew.
+static TrackingResult track(bool feedForward, uint32_t seconds, uint32_t settle = 120)
+{
+    Mirror mirror(feedForward);
+    TrackingResult result;
+    auto wallStart = std::chrono::steady_clock::now();
+    uint32_t ticksPerSecond = 1000000 / tickMicros;
+    for (uint32_t tick = 0; tick < seconds * ticksPerSecond; tick++) {
+        advanceMicros(tickMicros);
+        mirror.azimuthEncoder.getShaftAngle();
+        mirror.elevationEncoder.getShaftAngle();
+        auto tickStart = std::chrono::steady_clock::now();
+        mirror.heliostat.run();
+        double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - tickStart).count();
+        result.tickNanos += nanos;
+        result.tickMaxNanos = max(result.tickMaxNanos, nanos);
+        result.ticks++;
+        if (tick % ticksPerSecond != 0) continue;
+        // the builder task does this on the device
+        mirror.ephemeris.update();
+        SphericalCoordinate ideal;
+        if (tick / ticksPerSecond < settle || !mirror.heliostat.getReflection(now(), ideal)) continue;
+        float azimuthError = abs(mirror.azimuth.angularDistance(mirror.azimuthEncoder.getShaftAngle(), ideal.azimuth));
+        float elevationError = abs(mirror.elevation.angularDistance(mirror.elevationEncoder.getShaftAngle(), ideal.elevation));
+        float cachedError = abs(mirror.azimuth.angularDistance(mirror.azimuth.cachedAngle, mirror.azimuthEncoder.getShaftAngle()));
+        result.cachedMax = max(result.cachedMax, cachedError);
+        result.azimuthMax = max(result.azimuthMax, azimuthError);
+        result.elevationMax = max(result.elevationMax, elevationError);
+        result.azimuthSumSq += azimuthError * azimuthError;
+        result.elevationSumSq += elevationError * elevationError;
+        result.samples++;
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    result.tickNanos /= result.ticks;
+    result.commands = mirror.heliostat.getCommandCount();
+    result.slips = mirror.azimuth.slipCount + mirror.elevation.slipCount;
+    result.encoderReads = mirror.azimuthEncoder.quality.samples + mirror.elevationEncoder.quality.samples;
+    result.speedup = seconds / wall;
+    return result;
+}
+
+static void report(const char *name, TrackingResult &result)
+{
+    printf("%s : %.0f ns per tick (max %.0f), error max %.4f / %.4f deg, RMS %.4f / %.4f deg (azimuth / elevation), %u commands, %u encoder reads, %.0fx real time\n",
+        name, result.tickNanos, result.tickMaxNanos,
+        result.azimuthMax, result.elevationMax,
+        sqrt(result.azimuthSumSq / result.samples), sqrt(result.elevationSumSq / result.samples),
+        result.commands, result.encoderReads, result.speedup);
+}
+
+// Two simulated hours with the periodic re-aim moves
+void test_reaim_tracking()
+{
+    TrackingResult result = track(false, 7200);
+    report("re-aim", result);
+    TEST_ASSERT_GREATER_THAN(7000, result.samples);
+    // no steps are lost in the simulation, the slews must not look like slips
+    TEST_ASSERT_EQUAL_UINT32(0, result.slips);
+    // settled axes wait for the next re-aim, about one read per axis and
+    // 5 s instead of one per 500 ms
+    TEST_ASSERT_LESS_THAN(5000, result.encoderReads);
+    // the error grows to the 0.1° tolerance before a move, plus the encoder
+    // quantum and the move itself
+    TEST_ASSERT_LESS_THAN_FLOAT(0.2f, result.azimuthMax);
+    TEST_ASSERT_LESS_THAN_FLOAT(0.2f, result.elevationMax);
+}
+
+// Two simulated hours with the feed-forward velocity
+void test_feed_forward_tracking()
+{
+    TrackingResult result = track(true, 7200);
+    report("feed-forward", result);
+    TEST_ASSERT_GREATER_THAN(7000, result.samples);
+    TEST_ASSERT_EQUAL_UINT32(0, result.slips);
+    // the readers see the estimate of at most one status period ago
+    TEST_ASSERT_LESS_THAN_FLOAT(0.05f, result.cachedMax);
+    TEST_ASSERT_LESS_THAN_FLOAT(0.05f, result.azimuthMax);
+    TEST_ASSERT_LESS_THAN_FLOAT(0.05f, result.elevationMax);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_reaim_tracking);
+    RUN_TEST(test_feed_forward_tracking);
+    return UNITY_END();
+}
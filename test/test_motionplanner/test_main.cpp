@@ -0,0 +1,111 @@
+#include <unity.h>
+#include <motionplanner.h>
+
+// Limits of an axis with the default TMC5160Controller settings, in °
+static const float maxVelocity = 72.f;
+static const float maxAcceleration = 36.f;
+static const float maxJerk = 144.f;
+
+struct ProfileCheck
+{
+    float peakVelocity = 0.f;
+    float peakAcceleration = 0.f;
+    float peakJerk = 0.f;
+    MotionState end;
+};
+
+// Samples the move at 10^4 points. Position and velocity must be continuous
+// under the velocity and acceleration limits; the acceleration too under the
+// jerk limit, unless the move is trapezoidal.
+static ProfileCheck sampleProfile(SCurveProfile profile)
+{
+    const int samples = 10000;
+    float dt = profile.duration / samples;
+    ProfileCheck check;
+    MotionState previous = profile.getState(0.f);
+    TEST_ASSERT_EQUAL_FLOAT(0.f, previous.position);
+    TEST_ASSERT_EQUAL_FLOAT(0.f, previous.velocity);
+    for (int i = 1; i <= samples; i++) {
+        MotionState state = profile.getState(i * dt);
+        TEST_ASSERT_FLOAT_WITHIN(profile.velocity * dt * 1.001f + 1e-5f, previous.position, state.position);
+        TEST_ASSERT_FLOAT_WITHIN(profile.acceleration * dt * 1.001f + 1e-5f, previous.velocity, state.velocity);
+        check.peakVelocity = max(check.peakVelocity, abs(state.velocity));
+        check.peakAcceleration = max(check.peakAcceleration, abs(state.acceleration));
+        check.peakJerk = max(check.peakJerk, abs(state.acceleration - previous.acceleration) / dt);
+        previous = state;
+    }
+    check.end = previous;
+    return check;
+}
+
+static void checkArrival(SCurveProfile profile, ProfileCheck &check)
+{
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f * profile.distance + 1e-5f, profile.distance, check.end.position);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.f, check.end.velocity);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.f, check.end.acceleration);
+    // nothing moves past the end
+    TEST_ASSERT_EQUAL_FLOAT(check.end.position, profile.getState(profile.duration + 1.f).position);
+}
+
+// Long move reaching the peak velocity, medium one limited by the
+// acceleration, short ones limited by the jerk alone
+void test_scurve_limits_and_arrival()
+{
+    for (float distance : {180.f, 60.f, 10.f, 0.5f, -90.f}) {
+        SCurveProfile profile = SCurveProfile::plan(distance, maxVelocity, maxAcceleration, maxJerk);
+        TEST_ASSERT_EQUAL_FLOAT(abs(distance), profile.distance);
+        ProfileCheck check = sampleProfile(profile);
+        checkArrival(profile, check);
+        TEST_ASSERT_TRUE(check.peakVelocity <= maxVelocity * 1.0001f);
+        TEST_ASSERT_TRUE(check.peakAcceleration <= maxAcceleration * 1.0001f);
+        // continuous acceleration, the sampled jerk includes no step
+        TEST_ASSERT_TRUE(check.peakJerk <= maxJerk * 1.01f);
+    }
+}
+
+// The trapezoid of a zero jerk arrives sooner, with steps in acceleration
+void test_trapezoid_against_scurve()
+{
+    for (float distance : {180.f, 10.f}) {
+        SCurveProfile scurve = SCurveProfile::plan(distance, maxVelocity, maxAcceleration, maxJerk);
+        SCurveProfile trapezoid = SCurveProfile::plan(distance, maxVelocity, maxAcceleration, 0.f);
+        ProfileCheck scurveCheck = sampleProfile(scurve);
+        ProfileCheck trapezoidCheck = sampleProfile(trapezoid);
+        checkArrival(trapezoid, trapezoidCheck);
+        TEST_ASSERT_TRUE(trapezoid.duration < scurve.duration);
+        TEST_ASSERT_TRUE(trapezoidCheck.peakJerk > 100.f * maxJerk);
+        char message[120];
+        snprintf(message, sizeof(message), "%.0f deg : S-curve %.2f s, peak jerk %.0f deg/s3, trapezoid %.2f s",
+                 distance, scurve.duration, scurveCheck.peakJerk, trapezoid.duration);
+        TEST_MESSAGE(message);
+    }
+}
+
+// The faster axis is stretched to the slower one, and still arrives at
+// rest within its scaled limits
+void test_synchronize_equalizes_durations()
+{
+    SCurveProfile azimuth = SCurveProfile::plan(120.f, maxVelocity, maxAcceleration, maxJerk);
+    SCurveProfile elevation = SCurveProfile::plan(15.f, maxVelocity, maxAcceleration, maxJerk);
+    float slowest = azimuth.duration;
+    TEST_ASSERT_TRUE(elevation.duration < slowest);
+    SCurveProfile::synchronize(azimuth, elevation);
+    TEST_ASSERT_EQUAL_FLOAT(slowest, azimuth.duration);
+    TEST_ASSERT_EQUAL_FLOAT(slowest, elevation.duration);
+    SCurveProfile::synchronize(elevation, azimuth);
+    TEST_ASSERT_EQUAL_FLOAT(slowest, elevation.duration);
+    ProfileCheck check = sampleProfile(elevation);
+    checkArrival(elevation, check);
+    TEST_ASSERT_TRUE(check.peakVelocity <= elevation.velocity * 1.0001f);
+    TEST_ASSERT_TRUE(check.peakJerk <= elevation.jerk * 1.01f);
+    TEST_ASSERT_TRUE(elevation.jerk < maxJerk);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_scurve_limits_and_arrival);
+    RUN_TEST(test_trapezoid_against_scurve);
+    RUN_TEST(test_synchronize_equalizes_durations);
+    return UNITY_END();
+}
@@ -0,0 +1,93 @@
+#include <unity.h>
+#include <random>
+#include <pointingmodel.h>
+
+// IA, IE, CA, NPAE, AN, AW, TF in degrees
+static const double truth[PointingModel::size] = {0.5, -0.3, 0.2, 0.1, 0.05, -0.08, 0.15};
+
+// Axis position at which the spot lands on the target, from the model terms
+// written out as in pointingmodel.h, in double. h is the altitude of the
+// normal, the elevation axis counts down from the zenith.
+static SphericalCoordinate observe(SphericalCoordinate commanded)
+{
+    double A = radians(commanded.azimuth);
+    double h = radians(90. - commanded.elevation);
+    double dAzimuth = truth[0] + truth[2] / cos(h) + truth[3] * tan(h) + truth[4] * sin(A) * tan(h) - truth[5] * cos(A) * tan(h);
+    double dElevation = truth[1] - truth[4] * cos(A) - truth[5] * sin(A) + truth[6] * cos(h);
+    return {fmod(commanded.azimuth + dAzimuth + 360., 360.), commanded.elevation - dElevation};
+}
+
+// Mirror normals spread over the sky, altitude 10° to 80°
+static SphericalCoordinate randomDirection(std::mt19937 &random)
+{
+    std::uniform_real_distribution<double> azimuth(0., 360.);
+    std::uniform_real_distribution<double> elevation(10., 80.);
+    return {azimuth(random), elevation(random)};
+}
+
+void test_recovers_coefficients()
+{
+    std::mt19937 random(1);
+    std::normal_distribution<double> noise(0., 0.005);
+    PointingModel model;
+    for (int i = 0; i < 200; i++) {
+        SphericalCoordinate commanded = randomDirection(random);
+        SphericalCoordinate observed = observe(commanded);
+        observed.azimuth += noise(random);
+        observed.elevation += noise(random);
+        model.observe(commanded, observed);
+    }
+    TEST_ASSERT_EQUAL_UINT32(200, model.observations);
+    for (int i = 0; i < PointingModel::size; i++) {
+        TEST_ASSERT_FLOAT_WITHIN(0.01f, truth[i], model.parameters[i]);
+    }
+    // the a priori residuals include the first, unfitted observations
+    TEST_ASSERT_LESS_THAN_FLOAT(0.1f, model.getResidualRMS());
+}
+
+// With the fitted model, apply() sends the axes where the spot lands on
+// the target
+void test_apply_inverts_the_model()
+{
+    std::mt19937 random(2);
+    PointingModel model;
+    for (int i = 0; i < 100; i++) {
+        SphericalCoordinate commanded = randomDirection(random);
+        model.observe(commanded, observe(commanded));
+    }
+    SphericalCoordinate commanded = randomDirection(random);
+    TEST_ASSERT_EQUAL_FLOAT(commanded.azimuth, model.apply(commanded).azimuth);
+    model.enabled = true;
+    for (int i = 0; i < 100; i++) {
+        commanded = randomDirection(random);
+        SphericalCoordinate expected = observe(commanded);
+        SphericalCoordinate corrected = model.apply(commanded);
+        float azimuthError = (BinaryAngle::fromDegrees(corrected.azimuth) - BinaryAngle::fromDegrees(expected.azimuth)).toSignedDegrees();
+        TEST_ASSERT_FLOAT_WITHIN(1e-3f, 0.f, azimuthError);
+        TEST_ASSERT_FLOAT_WITHIN(1e-3f, expected.elevation, corrected.elevation);
+    }
+}
+
+// A reset model is the identity
+void test_reset()
+{
+    std::mt19937 random(3);
+    PointingModel model;
+    model.enabled = true;
+    SphericalCoordinate commanded = randomDirection(random);
+    model.observe(commanded, observe(commanded));
+    model.reset();
+    TEST_ASSERT_EQUAL_UINT32(0, model.observations);
+    SphericalCoordinate corrected = model.apply(commanded);
+    TEST_ASSERT_EQUAL_FLOAT(commanded.azimuth, corrected.azimuth);
+    TEST_ASSERT_EQUAL_FLOAT(commanded.elevation, corrected.elevation);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_recovers_coefficients);
+    RUN_TEST(test_apply_inverts_the_model);
+    RUN_TEST(test_reset);
+    return UNITY_END();
+}
@@ -0,0 +1,95 @@
+#include <unity.h>
+#include <thread>
+#include <samplering.h>
+
+// Sample whose fields must agree, a torn copy breaks the relation
+struct Sample
+{
+    uint32_t sequence;
+    uint32_t check;
+    uint64_t payload[6];
+};
+
+static Sample make(uint32_t sequence)
+{
+    Sample sample;
+    sample.sequence = sequence;
+    sample.check = ~sequence;
+    for (int i = 0; i < 6; i++) sample.payload[i] = uint64_t(sequence) * (i + 1);
+    return sample;
+}
+
+static bool intact(const Sample &sample)
+{
+    if (sample.check != ~sample.sequence) return false;
+    for (int i = 0; i < 6; i++) if (sample.payload[i] != uint64_t(sample.sequence) * (i + 1)) return false;
+    return true;
+}
+
+void test_single_thread()
+{
+    SampleRing<Sample, 8> ring;
+    Sample out[8];
+    TEST_ASSERT_FALSE(ring.latest(out[0]));
+    for (uint32_t i = 0; i < 20; i++) ring.push(make(i));
+    TEST_ASSERT_TRUE(ring.latest(out[0]));
+    TEST_ASSERT_EQUAL_UINT32(19, out[0].sequence);
+    // one slot is kept free for the producer
+    TEST_ASSERT_EQUAL_INT(7, ring.recent(out, 8));
+    TEST_ASSERT_EQUAL_UINT32(13, out[6].sequence);
+    uint32_t cursor = 0;
+    TEST_ASSERT_EQUAL_INT(7, ring.from(cursor, out, 8));
+    TEST_ASSERT_EQUAL_UINT32(13, out[0].sequence);
+    TEST_ASSERT_EQUAL_UINT32(20, cursor);
+}
+
+// A producer laps the readers continuously, no copy may be torn and the
+// sequences must never go back
+void test_concurrent_readers()
+{
+    SampleRing<Sample, 8> ring;
+    std::atomic<bool> done{false};
+    const uint32_t pushes = 2000000;
+    std::thread producer([&] {
+        for (uint32_t i = 0; i < pushes; i++) ring.push(make(i));
+        done = true;
+    });
+    uint32_t latestReads = 0, torn = 0, backwards = 0, last = 0;
+    uint32_t cursor = 0, expected = 0, skipped = 0;
+    Sample out[4];
+    while (!done) {
+        if (ring.latest(out[0])) {
+            latestReads++;
+            if (!intact(out[0])) torn++;
+            if (out[0].sequence < last) backwards++;
+            last = out[0].sequence;
+        }
+        int count = ring.recent(out, 4);
+        for (int i = 0; i < count; i++) {
+            if (!intact(out[i])) torn++;
+            if (i > 0 && out[i].sequence != out[i - 1].sequence - 1) backwards++;
+        }
+        count = ring.from(cursor, out, 4);
+        for (int i = 0; i < count; i++) {
+            if (!intact(out[i])) torn++;
+            if (out[i].sequence < expected) backwards++;
+            skipped += out[i].sequence - expected;
+            expected = out[i].sequence + 1;
+        }
+    }
+    producer.join();
+    char message[80];
+    snprintf(message, sizeof(message), "%u latest() reads, %u samples skipped by from()", latestReads, skipped);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL_UINT32(0, torn);
+    TEST_ASSERT_EQUAL_UINT32(0, backwards);
+    TEST_ASSERT_GREATER_THAN(0, latestReads);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_single_thread);
+    RUN_TEST(test_concurrent_readers);
+    return UNITY_END();
+}